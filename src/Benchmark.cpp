@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <Console.h>
+
+/*
+ * Headless benchmark: runs a rom for a fixed number of frames with no
+ * video, audio or frame pacing, then reports throughput and a hash of
+ * every frame rendered. Builds made with different compile time
+ * options (see the Makefile's bench variants) can be compared by
+ * running them over the same rom; matching hashes mean matching output.
+ * Passing --cpu instead of a rom runs a built in cpu bound program.
+ * With --trace, a CPU_TRACE build also writes out the last instructions
+ * run, for diffing against another build's trace. With --profile, a
+ * CPU_PROFILE build writes where the emulated cycles went. With
+ * --indexed, frames are kept as palette indices and only turned into
+ * colours when they're hashed. --ppu picks the ppu backend, and
+ * --compare-ppus runs the rom on both side by side, reporting each one's
+ * speed and the frames on which their output differs. --render-every n
+ * only draws every nth frame, as when fast forwarding, and hashes just
+ * those. Frames left unchanged from the last one aren't drawn again, and
+ * are counted.
+ */
+
+static const int DEFAULT_FRAMES = 3600;
+
+/*
+ * A fixed cpu bound workload with rendering disabled: a pseudo random
+ * shift register xored over page 3 through indexed and indirect stores,
+ * with a subroutine call per pass. NMI is left enabled, and its handler
+ * counts frames in $15. Assembled at $C000.
+ *
+ * reset: SEI / CLD / LDX #$FF / TXS / LDA #$80 / STA $2000 / LDA #0 /
+ *        STA $2001 / LDA #$34 / STA $10 / LDA #0 / STA $20 / LDA #3 /
+ *        STA $21
+ * loop:  LDX #0
+ * l1:    LDA $10 / ASL A / BCC l2 / EOR #$1D
+ * l2:    STA $10 / ADC $0300,X / STA $0300,X / LDY #0 / LDA ($20),Y /
+ *        EOR $10 / STA ($20),Y / INC $21 / LDA $21 / AND #3 / ORA #3 /
+ *        STA $21 / TXA / CLC / ADC #7 / TAX / CMP #$F0 / BCC l1 /
+ *        JSR sub / DEC $11 / BNE loop / INC $12 / JMP loop
+ * sub:   LDA $12 / ROR A / ROL $13 / LSR $14 / BIT $13 / BVC s1 / SEC /
+ *        SBC #3
+ * s1:    CMP #$40 / BNE s2 / NOP
+ * s2:    RTS
+ * nmi:   INC $15 / RTI
+ * irq:   RTI
+ */
+static const uint8_t CPU_BENCH_PROGRAM[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A, 0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x00,
+    0x8D, 0x01, 0x20, 0xA9, 0x34, 0x85, 0x10, 0xA9, 0x00, 0x85, 0x20, 0xA9,
+    0x03, 0x85, 0x21, 0xA2, 0x00, 0xA5, 0x10, 0x0A, 0x90, 0x02, 0x49, 0x1D,
+    0x85, 0x10, 0x7D, 0x00, 0x03, 0x9D, 0x00, 0x03, 0xA0, 0x00, 0xB1, 0x20,
+    0x45, 0x10, 0x91, 0x20, 0xE6, 0x21, 0xA5, 0x21, 0x29, 0x03, 0x09, 0x03,
+    0x85, 0x21, 0x8A, 0x18, 0x69, 0x07, 0xAA, 0xC9, 0xF0, 0x90, 0xD6, 0x20,
+    0x53, 0xC0, 0xC6, 0x11, 0xD0, 0xCD, 0xE6, 0x12, 0x4C, 0x1B, 0xC0, 0xA5,
+    0x12, 0x6A, 0x26, 0x13, 0x46, 0x14, 0x24, 0x13, 0x50, 0x03, 0x38, 0xE9,
+    0x03, 0xC9, 0x40, 0xD0, 0x01, 0xEA, 0x60, 0xE6, 0x15, 0x40, 0x40,
+};
+static const uint16_t CPU_BENCH_NMI = 0xC067;
+static const uint16_t CPU_BENCH_RESET = 0xC000;
+static const uint16_t CPU_BENCH_IRQ = 0xC06A;
+
+// wraps the program above in a mapper 0 iNES image
+static std::string makeCpuBenchRom()
+{
+    std::string prg(PRG_BANK_SIZE, (char)0xEA);
+    prg.replace(0, sizeof(CPU_BENCH_PROGRAM),
+		(const char *)CPU_BENCH_PROGRAM, sizeof(CPU_BENCH_PROGRAM));
+    const uint16_t vectors[] = {CPU_BENCH_NMI, CPU_BENCH_RESET, CPU_BENCH_IRQ};
+    for (int i = 0; i < 3; ++i) {
+	prg[PRG_BANK_SIZE - 6 + i*2] = vectors[i] & 0xFF;
+	prg[PRG_BANK_SIZE - 5 + i*2] = vectors[i] >> 8;
+    }
+    std::string header("NES\x1A\x01\x01", 6);
+    header.resize(16, 0);
+    return header + prg + std::string(CHR_BANK_SIZE, 0);
+}
+
+static uint64_t hashFrame(uint64_t hash, const uint32_t *frameBuffer)
+{
+    // FNV-1a, a pixel at a time
+    for (unsigned int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; ++i) {
+	hash ^= frameBuffer[i];
+	hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static bool loadRom(Console& console, const std::string& romFileName)
+{
+    try {
+	if (romFileName == "--cpu") {
+	    std::istringstream romStream(makeCpuBenchRom());
+	    console.loadINesStream(romStream);
+	} else {
+	    console.loadINesFile(romFileName);
+	}
+    } catch (const std::exception& e) {
+	printf("Loading rom file failed: %s\n", e.what());
+	return false;
+    }
+    return true;
+}
+
+int main(int argc, char *args[])
+{
+    bool indexed = false;
+    PpuBackend ppuBackend = PPU_BACKEND_SCANLINE;
+    bool comparePpus = false;
+    int renderEvery = 1;
+    std::string traceFileName;
+    std::string profileName;
+    while (argc > 1) {
+	std::string option(args[1]);
+	if (option == "--indexed") {
+	    indexed = true;
+	} else if (option == "--ppu" && argc > 2) {
+	    std::string name(args[2]);
+	    if (name == "dot") {
+		ppuBackend = PPU_BACKEND_DOT;
+	    } else if (name != "scanline") {
+		printf("Unknown ppu backend: %s\n", name.c_str());
+		return 1;
+	    }
+	    ++args;
+	    --argc;
+	} else if (option == "--compare-ppus") {
+	    comparePpus = true;
+	} else if (option == "--render-every" && argc > 2) {
+	    renderEvery = std::max(1, atoi(args[2]));
+	    ++args;
+	    --argc;
+	} else if (option == "--trace" && argc > 2) {
+	    traceFileName = args[2];
+	    ++args;
+	    --argc;
+	} else if (option == "--profile" && argc > 2) {
+	    profileName = args[2];
+	    ++args;
+	    --argc;
+	} else {
+	    break;
+	}
+	++args;
+	--argc;
+    }
+    if (argc < 2) {
+	printf("Usage: %s [--indexed] [--ppu scanline|dot] [--compare-ppus] [--render-every n] [--trace trace.log] [--profile name] path_to_rom.nes|--cpu [frames]\n", args[0]);
+	return 1;
+    }
+    std::string romFileName(args[1]);
+    int frames = (argc > 2) ? atoi(args[2]) : DEFAULT_FRAMES;
+
+    static Console console;
+    console.setPpuBackend(comparePpus ? PPU_BACKEND_SCANLINE : ppuBackend);
+    console.setIndexedFrameOutput(indexed);
+    if (!loadRom(console, romFileName)) {
+	return 1;
+    }
+    // given the same input, the other backend should draw the same frames
+    static Console other;
+    if (comparePpus) {
+	other.setPpuBackend(PPU_BACKEND_DOT);
+	other.setIndexedFrameOutput(indexed);
+	if (!loadRom(other, romFileName)) {
+	    return 1;
+	}
+    }
+
+    uint64_t frameHash = 0xCBF29CE484222325ULL;
+    double seconds = 0;
+    double otherSeconds = 0;
+    int matchingFrames = 0;
+    int firstDifference = -1;
+    int changedFrames = 0;
+    for (int i = 0; i < frames; ++i) {
+	// only time the emulation and getting the frame's colours, not
+	// hashing or sample draining
+	bool render = i % renderEvery == renderEvery - 1;
+	auto start = std::chrono::steady_clock::now();
+	console.runForOneFrame(render);
+	uint32_t *frameBuffer = console.getFrameBuffer();
+	auto end = std::chrono::steady_clock::now();
+	seconds += std::chrono::duration<double>(end - start).count();
+	if (render) {
+	    frameHash = hashFrame(frameHash, frameBuffer);
+	}
+	changedFrames += console.frameChanged();
+	console.getAvailableSamples();
+
+	if (comparePpus) {
+	    start = std::chrono::steady_clock::now();
+	    other.runForOneFrame(render);
+	    uint32_t *otherFrameBuffer = other.getFrameBuffer();
+	    end = std::chrono::steady_clock::now();
+	    otherSeconds += std::chrono::duration<double>(end - start).count();
+	    if (memcmp(frameBuffer, otherFrameBuffer,
+		       FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t)) == 0) {
+		++matchingFrames;
+	    } else if (firstDifference < 0) {
+		firstDifference = i;
+	    }
+	    other.getAvailableSamples();
+	}
+    }
+
+    uint64_t instructions = console.getCpuInstructionCount();
+    uint64_t cycles = console.getCpuCycles();
+    printf("frame output:      %s\n", indexed ? "indexed" : "rgb");
+    printf("ppu:               %s\n", console.getPpuName());
+    printf("frames:            %d\n", frames);
+    if (renderEvery > 1) {
+	printf("rendered frames:   %d\n", frames / renderEvery);
+    }
+    printf("changed frames:    %d\n", changedFrames);
+    printf("seconds:           %.3f\n", seconds);
+    printf("frames/sec:        %.1f\n", frames / seconds);
+    printf("instructions/sec:  %.0f\n", instructions / seconds);
+    printf("emulated cpu MHz:  %.2f\n", cycles / seconds / 1e6);
+    printf("frame hash:        %016llx\n", (unsigned long long)frameHash);
+    if (comparePpus) {
+	printf("%-19s%.1f frames/sec\n", (std::string(other.getPpuName()) + " ppu:").c_str(),
+	       frames / otherSeconds);
+	printf("matching frames:   %d/%d\n", matchingFrames, frames);
+	if (firstDifference >= 0) {
+	    printf("first difference:  frame %d\n", firstDifference);
+	}
+    }
+
+    if (!traceFileName.empty()) {
+	std::ofstream traceFile(traceFileName.c_str());
+	if (!console.writeCpuTrace(traceFile)) {
+	    printf("cpu trace:         not built in (make bench VARIANT=trace)\n");
+	}
+    }
+    if (!profileName.empty()) {
+	// a summary, and collapsed stacks for flamegraph.pl
+	std::ofstream summaryFile((profileName + ".txt").c_str());
+	std::ofstream stacksFile((profileName + ".folded").c_str());
+	if (!console.writeCpuProfile(summaryFile, stacksFile)) {
+	    printf("cpu profile:       not built in (make bench VARIANT=profile)\n");
+	}
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <MemoryMap.h>
+
+/*
+ * Notes:
+ *
+ * - A block is a run of instructions decoded ahead of time, ending at
+ * the first branch, jump, call, return or JAM. Blocks never cross a
+ * page, so they are keyed by the host page they were decoded from (the
+ * mapped bank) along with their pc. A bank switch remaps the page and
+ * so simply stops the old blocks from matching.
+ *
+ * - Code decoded from writable memory marks every cpu page mirroring
+ * that memory, and a write to a marked page drops the blocks decoded
+ * from it. The marks are cleared again until the code is re-decoded.
+ * Any remap can change which pages mirror what, so it drops every
+ * writable block and its marks.
+ *
+ * - The cache is direct mapped on pc, so colliding blocks just evict
+ * each other.
+ */
+
+static const int BLOCK_CACHE_SIZE = 2048;
+static const int BLOCK_MAX_OPS = 16;
+
+struct DecodedOp
+{
+    uint8_t opCode;
+    uint16_t operand;
+};
+
+struct Block
+{
+    // host memory the block was decoded from, NULL if unused
+    const uint8_t *page;
+    // decoded from memory the cpu can write to
+    bool writable;
+    uint16_t pc;
+    // pc of the last instruction
+    uint16_t endPc;
+    int count;
+    DecodedOp ops[BLOCK_MAX_OPS];
+};
+
+class BlockCache
+{
+public:
+    BlockCache() : blocks(BLOCK_CACHE_SIZE) {
+	flush();
+    }
+    void flush() {
+	for (Block &block : blocks) {
+	    block.page = NULL;
+	    block.writable = false;
+	}
+	for (int i = 0; i < CPU_PAGE_COUNT; ++i) {
+	    codePages[i] = false;
+	}
+    }
+    Block *find(uint16_t pc, const uint8_t *page) {
+	Block &block = blocks[pc & (BLOCK_CACHE_SIZE - 1)];
+	if (block.page == page && block.pc == pc) {
+	    return &block;
+	}
+	return NULL;
+    }
+    // the slot a block for pc is decoded into, evicting what was there
+    Block &getSlot(uint16_t pc) {
+	return blocks[pc & (BLOCK_CACHE_SIZE - 1)];
+    }
+    bool isCodePage(uint16_t addr) {
+	return codePages[addr >> 8];
+    }
+    void markCodePage(uint16_t addr, bool isCode) {
+	codePages[addr >> 8] = isCode;
+    }
+    void invalidate(const uint8_t *page) {
+	for (Block &block : blocks) {
+	    if (block.page == page) {
+		block.page = NULL;
+	    }
+	}
+    }
+    void invalidateWritable() {
+	for (Block &block : blocks) {
+	    if (block.writable) {
+		block.page = NULL;
+	    }
+	}
+	for (int i = 0; i < CPU_PAGE_COUNT; ++i) {
+	    codePages[i] = false;
+	}
+    }
+
+private:
+    std::vector<Block> blocks;
+    bool codePages[CPU_PAGE_COUNT];
+};
+
+#endif
@@ -1,995 +1,1384 @@
 #include <cstdint>
 
 #include <CPU.h>
-
-void CPU::reset()
-{
-    pc = 0x0000;
-    sp = 0xFD;
-    acc = 0x00;
-    x = 0x00;
-    y = 0x00;
-    carry = 0;
-    zero = 0;
-    intdisable = 1;
-    decmode = 0;
-    brk = 0;
-    overflow = 0;
-    negative = 0;
+#include <Console.h>
+
+#ifndef CPU_STEP_IDLE_LOOPS
+// the largest loops skipIdleLoop() looks at, in bytes and instructions
+static const int IDLE_MAX_LOOP_SIZE = 32;
+static const int IDLE_MAX_OPS = 8;
+#endif
+
+template <class Bus>
+CPU<Bus>::CPU(Bus &bus) : bus(bus), instrCycles(0)
+{
+#ifndef CPU_STEP_IDLE_LOOPS
+    idleProbe = false;
+#endif
+}
+
+template <class Bus>
+void CPU<Bus>::reset()
+{
+    regs.pc = 0x0000;
+    regs.sp = 0xFD;
+    regs.acc = 0x00;
+    regs.x = 0x00;
+    regs.y = 0x00;
+    regs.carry = 0;
+    setZero(regs, 1);
+    regs.intdisable = 1;
+    regs.decmode = 0;
+    regs.brk = 0;
+    regs.overflow = 0;
+    setNegative(regs, 0);
 
     nmiSignal = 0;
     irqSignal = 0;
+    jammed = 0;
 
-    targetAddr = loadAddr(RESET_VECTOR);
-    operand16 = 0x0000;
-    operand8 = 0x00;
-    useAcc = 0;
+    regs.pc = loadAddr(RESET_VECTOR);
 
-    OpJMP();
+    cycles = 0;
+    stallCycles = 0;
+    instructionCount = 0;
+    profile.resetStack();
 
-    cyclesLeft = 0;
+#ifndef CPU_STEP_IDLE_LOOPS
+    // matches no loop
+    idleRejectedHead = 1;
+    idleRejectedTail = 0;
+#endif
+#ifdef CPU_BLOCK_CACHE
+    // a new cart can reuse the host memory of the old one
+    blockCache.flush();
+    codeInvalidated = 0;
+    mapGeneration = bus.getMapGeneration();
+#endif
 }
 
-void CPU::push8(uint8_t value)
+template <class Bus>
+void CPU<Bus>::push8(Registers &r, uint8_t value)
 {
-    write(sp | 0x0100, value);
-    sp -= 1;
+    write(r.sp | 0x0100, value);
+    r.sp -= 1;
 }
 
-void CPU::push16(uint16_t value)
+template <class Bus>
+void CPU<Bus>::push16(Registers &r, uint16_t value)
 {
-    push8((value >> 8) & 0xFF);
-    push8(value & 0xFF);
+    push8(r, (value >> 8) & 0xFF);
+    push8(r, value & 0xFF);
 }
 
-uint8_t CPU::pop8()
+template <class Bus>
+uint8_t CPU<Bus>::pop8(Registers &r)
 {
-    sp += 1;
-    return read(sp | 0x0100);
+    r.sp += 1;
+    return read(r.sp | 0x0100);
 }
 
-uint16_t CPU::pop16()
+template <class Bus>
+uint16_t CPU<Bus>::pop16(Registers &r)
 {
-    uint8_t low = pop8();
-    uint8_t high = pop8();
+    uint8_t low = pop8(r);
+    uint8_t high = pop8(r);
     return low | (high << 8);
 }
 
-uint16_t CPU::loadAddr(uint16_t addr)
+template <class Bus>
+uint16_t CPU<Bus>::loadAddr(uint16_t addr)
 {
     uint8_t low = read(addr);
     uint8_t high = read(addr+1);
     return low | (high << 8);
 }
 
-uint8_t CPU::getStatus()
+template <class Bus>
+uint8_t CPU<Bus>::getStatus(Registers &r)
 {
     uint8_t flags =
-        (carry      << 0) |
-        (zero       << 1) |
-        (intdisable << 2) |
-        (decmode    << 3) |
-        (brk        << 4) |
+        (r.carry      << 0) |
+        (getZero(r)   << 1) |
+        (r.intdisable << 2) |
+        (r.decmode    << 3) |
+        (r.brk        << 4) |
         (0x1        << 5) |
-        (overflow   << 6) |
-        (negative   << 7);
+        (r.overflow   << 6) |
+        (getNegative(r) << 7);
     return flags;
 }
 
-void CPU::setStatus(uint8_t value)
+template <class Bus>
+void CPU<Bus>::setStatus(Registers &r, uint8_t value)
 {
-    carry       = !!(value & 0x01);
-    zero        = !!(value & 0x02);
-    intdisable  = !!(value & 0x04);
-    decmode     = !!(value & 0x08);
-    brk         = !!(value & 0x10);
+    r.carry       = !!(value & 0x01);
+    setZero(r, (value & 0x02) ? 0 : 1);
+    r.intdisable  = !!(value & 0x04);
+    r.decmode     = !!(value & 0x08);
+    r.brk         = !!(value & 0x10);
     // bit 5 unused
-    overflow    = !!(value & 0x40);
-    negative    = !!(value & 0x80);
+    r.overflow    = !!(value & 0x40);
+    setNegative(r, value);
+}
+
+#ifdef CPU_LAZY_FLAGS
+
+template <class Bus>
+void CPU<Bus>::setZero(Registers &r, uint8_t result)
+{
+    r.zeroResult = result;
+}
+
+template <class Bus>
+void CPU<Bus>::setNegative(Registers &r, uint8_t result)
+{
+    r.negativeResult = result;
+}
+
+template <class Bus>
+int CPU<Bus>::getZero(Registers &r)
+{
+    return r.zeroResult == 0;
+}
+
+template <class Bus>
+int CPU<Bus>::getNegative(Registers &r)
+{
+    return r.negativeResult >> 7;
+}
+
+#else
+
+template <class Bus>
+void CPU<Bus>::setZero(Registers &r, uint8_t result)
+{
+    r.zero = (result == 0);
+}
+
+template <class Bus>
+void CPU<Bus>::setNegative(Registers &r, uint8_t result)
+{
+    r.negative = !!(result & 0x80);
 }
 
-void CPU::handleInterrupts()
+template <class Bus>
+int CPU<Bus>::getZero(Registers &r)
+{
+    return r.zero;
+}
+
+template <class Bus>
+int CPU<Bus>::getNegative(Registers &r)
+{
+    return r.negative;
+}
+
+#endif
+
+template <class Bus>
+void CPU<Bus>::setZN(Registers &r, uint8_t result)
+{
+    setZero(r, result);
+    setNegative(r, result);
+}
+
+template <class Bus>
+int CPU<Bus>::handleInterrupts(Registers &r)
 {
     if(nmiSignal) {
-        push16(pc);
-        push8(getStatus() & ~(0x20));
-        intdisable = 1;
-        pc = loadAddr(NMI_VECTOR);
-        suspend(7);
+        push16(r, r.pc);
+        push8(r, getStatus(r) & ~(0x20));
+        r.intdisable = 1;
+        r.pc = loadAddr(NMI_VECTOR);
         nmiSignal = 0;
-    } else if(irqSignal && !intdisable) {
-        push16(pc);
-        push8(getStatus() & ~(0x20));
-        intdisable = 1;
-        pc = loadAddr(IRQ_VECTOR);
-        suspend(7);
+        return 7;
+    } else if(irqSignal && !r.intdisable) {
+        push16(r, r.pc);
+        push8(r, getStatus(r) & ~(0x20));
+        r.intdisable = 1;
+        r.pc = loadAddr(IRQ_VECTOR);
         irqSignal = 0;
+        return 7;
     }
+    return 0;
 }
 
-void CPU::branch()
+template <class Bus>
+int CPU<Bus>::branch(Registers &r, uint16_t addr)
 {
-    // the offset is stored as a signed byte
-    int8_t offset = (int8_t)read(targetAddr);
-    uint16_t branchAddr = pc + offset;
-    if((branchAddr & 0xFF00) != (pc & 0xFF00)) {
+    int extraCycles = 1;
+    if((addr & 0xFF00) != (r.pc & 0xFF00)) {
         // page boundary crossed
-        suspend(2);
-    } else {
-        suspend(1);
+        extraCycles = 2;
+    }
+    r.pc = addr;
+    return extraCycles;
+}
+
+template <class Bus>
+void CPU<Bus>::suspend(int cycles)
+{
+    stallCycles += cycles;
+}
+
+template <class Bus>
+int64_t CPU<Bus>::run(int64_t cycleBudget)
+{
+    // work on a local copy of the registers so that they can be kept
+    // in host registers rather than reloaded through this
+    Registers r = regs;
+    uint64_t startCycle = cycles;
+    uint64_t endCycle = cycles + cycleBudget;
+    uint64_t instructions = 0;
+    while (cycles < endCycle) {
+        if (jammed) {
+            cycles = endCycle;
+            break;
+        }
+#ifdef CPU_BLOCK_CACHE
+        Block *block = getBlock(r.pc);
+        if (block) {
+            int count = runBlock(r, *block, endCycle);
+            instructions += count;
+#ifndef CPU_STEP_IDLE_LOOPS
+            uint16_t tail = block->endPc;
+            if (count == block->count && r.pc <= tail && tail - r.pc < IDLE_MAX_LOOP_SIZE) {
+                instructions += skipIdleLoop(r, tail, endCycle);
+            }
+#endif
+            continue;
+        }
+#endif
+        // cycles is only advanced between instructions, so bus accesses
+        // see the cycle their instruction started on
+        uint16_t pc = r.pc;
+        cycles += executeNextOp(r);
+        ++instructions;
+        cycles += stallCycles;
+        stallCycles = 0;
+#ifndef CPU_STEP_IDLE_LOOPS
+        if (r.pc <= pc && pc - r.pc < IDLE_MAX_LOOP_SIZE) {
+            instructions += skipIdleLoop(r, pc, endCycle);
+        }
+#endif
+    }
+    regs = r;
+    instructionCount += instructions;
+    return cycles - startCycle;
+}
+
+#ifdef CPU_BLOCK_CACHE
+
+template <class Bus>
+Block *CPU<Bus>::getBlock(uint16_t pc)
+{
+    if (bus.getMapGeneration() != mapGeneration) {
+        blockCache.invalidateWritable();
+        mapGeneration = bus.getMapGeneration();
+    }
+    const uint8_t *page = bus.getReadPage(pc);
+    if (!page) {
+        return NULL; // registers or unmapped, always interpreted
+    }
+    Block *block = blockCache.find(pc, page);
+    if (!block) {
+        block = &blockCache.getSlot(pc);
+        decodeBlock(*block, pc, page);
+        if (block->count == 0) {
+            return NULL;
+        }
+    }
+    return block;
+}
+
+template <class Bus>
+void CPU<Bus>::decodeBlock(Block &block, uint16_t pc, const uint8_t *page)
+{
+    block.page = page;
+    block.pc = pc;
+    block.count = 0;
+    int offset = pc & 0xFF;
+    while (block.count < BLOCK_MAX_OPS) {
+        uint8_t opCode = page[offset];
+        int length = 1 + getOperandLength(OPCODES[opCode].mode);
+        if (offset + length > CPU_PAGE_SIZE) {
+            break; // left to the interpreter
+        }
+        DecodedOp &op = block.ops[block.count++];
+        op.opCode = opCode;
+        op.operand = 0;
+        if (length > 1) {
+            op.operand |= page[offset + 1];
+        }
+        if (length > 2) {
+            op.operand |= page[offset + 2] << 8;
+        }
+        block.endPc = pc + offset - (pc & 0xFF);
+        offset += length;
+        if (isControlFlow(OPCODES[opCode].operation)) {
+            break;
+        }
     }
-    pc = branchAddr;
+    if (block.count == 0) {
+        block.page = NULL;
+        return;
+    }
+
+    uint8_t *writePage = bus.getWritePage(pc);
+    block.writable = (writePage != NULL);
+    if (block.writable) {
+        // mark every mirror of this memory, since a write through any
+        // of them changes the code
+        for (int addr = 0; addr < CPU_PAGE_SIZE * CPU_PAGE_COUNT; addr += CPU_PAGE_SIZE) {
+            if (bus.getWritePage(addr) == writePage) {
+                blockCache.markCodePage(addr, true);
+            }
+        }
+    }
+}
+
+template <class Bus>
+int CPU<Bus>::runBlock(Registers &r, const Block &block, uint64_t endCycle)
+{
+    codeInvalidated = 0;
+    int count = 0;
+    while (count < block.count) {
+        cycles += runDecodedInstr(r, block.ops[count]);
+        ++count;
+        int interruptCycles = handleInterrupts(r);
+        cycles += interruptCycles + stallCycles;
+        stallCycles = 0;
+        // stop early if pc has moved off the block or the block may
+        // no longer match memory
+        if (interruptCycles || codeInvalidated || jammed || cycles >= endCycle) {
+            break;
+        }
+    }
+    return count;
 }
 
-void CPU::suspend(int cycles)
+template <class Bus>
+void CPU<Bus>::invalidateCode(uint16_t addr)
 {
-    cyclesLeft += cycles;
+    uint8_t *writePage = bus.getWritePage(addr);
+    blockCache.invalidate(writePage);
+    for (int mirror = 0; mirror < CPU_PAGE_SIZE * CPU_PAGE_COUNT; mirror += CPU_PAGE_SIZE) {
+        if (bus.getWritePage(mirror) == writePage) {
+            blockCache.markCodePage(mirror, false);
+        }
+    }
+    blockCache.markCodePage(addr, false);
+    codeInvalidated = 1;
 }
 
-void CPU::tick()
+#endif
+
+#ifndef CPU_STEP_IDLE_LOOPS
+
+template <class Bus>
+uint64_t CPU<Bus>::skipIdleLoop(Registers &r, uint16_t tail, uint64_t endCycle)
 {
-    if (cyclesLeft == 0) {
-	executeNextOp();
+    uint16_t head = r.pc;
+    if (cycles >= endCycle || (head == idleRejectedHead && tail == idleRejectedTail)) {
+        return 0;
+    }
+    Registers start = r;
+    uint64_t startCycle = cycles;
+    int count = 0;
+    idleProbe = true;
+    idleClean = true;
+    do {
+        cycles += executeNextOp(r);
+        ++count;
+        cycles += stallCycles;
+        stallCycles = 0;
+    } while (r.pc != head && r.pc >= head && r.pc <= tail &&
+             count < IDLE_MAX_OPS && !jammed && cycles < endCycle);
+    idleProbe = false;
+
+    if (r.pc != head) {
+        if (r.pc >= head && r.pc <= tail && count == IDLE_MAX_OPS) {
+            // too long to be worth probing
+            idleRejectedHead = head;
+            idleRejectedTail = tail;
+        }
+        return count; // left the loop, or ran out of budget
+    }
+    if (!idleClean || !sameRegisters(r, start)) {
+        idleRejectedHead = head;
+        idleRejectedTail = tail;
+        return count;
     }
-    cyclesLeft -= 1;
+    if (cycles >= endCycle) {
+        return count;
+    }
+    // every further iteration reads the same values from the same state,
+    // and no read before endCycle can see the next event, so they can all
+    // be skipped up to where stepping them would have stopped
+    uint64_t loopCycles = cycles - startCycle;
+    uint64_t loops = (endCycle - cycles) / loopCycles;
+    cycles += loops * loopCycles;
+    return count * (loops + 1);
 }
 
-void CPU::signalNMI()
+template <class Bus>
+bool CPU<Bus>::sameRegisters(const Registers &a, const Registers &b)
+{
+    return a.pc == b.pc && a.sp == b.sp && a.acc == b.acc &&
+        a.x == b.x && a.y == b.y && a.carry == b.carry &&
+        a.intdisable == b.intdisable && a.decmode == b.decmode &&
+        a.brk == b.brk && a.overflow == b.overflow &&
+#ifdef CPU_LAZY_FLAGS
+        a.zeroResult == b.zeroResult && a.negativeResult == b.negativeResult;
+#else
+        a.zero == b.zero && a.negative == b.negative;
+#endif
+}
+
+#endif
+
+template <class Bus>
+void CPU<Bus>::signalNMI()
 {
     nmiSignal = 1;
+#ifndef CPU_STEP_IDLE_LOOPS
+    // a loop rejected before may now wait on what the handler changes
+    idleRejectedHead = 1;
+    idleRejectedTail = 0;
+#endif
 }
 
-void CPU::signalIRQ()
+template <class Bus>
+void CPU<Bus>::signalIRQ()
 {
     irqSignal = 1;
 }
 
-void CPU::executeNextOp()
+template <class Bus>
+int CPU<Bus>::executeNextOp(Registers &r)
 {
-    runInstr(read(pc));
-    handleInterrupts();
+    if (CpuTrace::ENABLED) {
+        traceInstr(r);
+    }
+    if (CpuProfile::ENABLED) {
+        return profileInstr(r);
+    }
+    int cycles = runInstr(r, read(r.pc));
+    return cycles + handleInterrupts(r);
+}
+
+template <class Bus>
+void CPU<Bus>::traceInstr(Registers &r)
+{
+    TraceEntry entry;
+    entry.pc = r.pc;
+    entry.bytes[0] = read(r.pc);
+    entry.length = 1 + getOperandLength(OPCODES[entry.bytes[0]].mode);
+    for (int i = 1; i < 3; ++i) {
+        entry.bytes[i] = (i < entry.length) ? read(r.pc + i) : 0;
+    }
+    entry.acc = r.acc;
+    entry.x = r.x;
+    entry.y = r.y;
+    // as pushed by PHP, less the break flag
+    entry.status = getStatus(r) & ~0x10;
+    entry.sp = r.sp;
+    entry.cycles = cycles;
+    trace.record(entry);
+}
+
+template <class Bus>
+int CPU<Bus>::profileInstr(Registers &r)
+{
+    uint16_t pc = r.pc;
+    uint8_t opCode = read(pc);
+    int cycles = runInstr(r, opCode);
+    // along with any DMA the instruction started
+    profile.count(pc, bus.getPrgBank(pc), opCode, cycles + stallCycles);
+    profile.leave(r.sp);
+    if (opCode == 0x20 || opCode == 0x00) { // JSR or BRK
+        profile.enter(r.pc, bus.getPrgBank(r.pc), r.sp);
+    }
+    int interruptCycles = handleInterrupts(r);
+    if (interruptCycles) {
+        profile.enter(r.pc, bus.getPrgBank(r.pc), r.sp);
+    }
+    return cycles + interruptCycles;
 }
 
 /* Instructions */
 
-void CPU::OpADC()
+template <class Bus>
+void CPU<Bus>::OpADC(Registers &r, uint16_t addr)
 {
-    int memAdd = read(targetAddr);
-    int tempAcc = acc + memAdd + (carry ? 1 : 0);
-    zero = (tempAcc & 0xFF) == 0;
-    negative = !!(tempAcc & 0x80);
-    carry = (tempAcc >> 8) != 0;
-    overflow = (((acc ^ tempAcc) & (memAdd ^ tempAcc)) & 0x80) != 0;
-    acc = tempAcc & 0xFF;
+    int memAdd = read(addr);
+    int tempAcc = r.acc + memAdd + (r.carry ? 1 : 0);
+    setZN(r, tempAcc);
+    r.carry = (tempAcc >> 8) != 0;
+    r.overflow = (((r.acc ^ tempAcc) & (memAdd ^ tempAcc)) & 0x80) != 0;
+    r.acc = tempAcc & 0xFF;
 }
 
-void CPU::OpAND()
+template <class Bus>
+void CPU<Bus>::OpAND(Registers &r, uint16_t addr)
 {
-    acc &= read(targetAddr);
-    zero = (acc == 0);
-    negative = !!(acc & 0x80);
+    r.acc &= read(addr);
+    setZN(r, r.acc);
 }
 
-void CPU::OpASL()
+template <class Bus>
+void CPU<Bus>::OpASL(Registers &r, uint16_t addr, bool useAcc)
 {
     uint8_t result = 0;
     if(useAcc) {
-        carry = !!(acc & 0x80);
-        result = acc << 1;
-        acc = result;
-        useAcc = 0;
+        r.carry = !!(r.acc & 0x80);
+        result = r.acc << 1;
+        r.acc = result;
     } else {
-        uint8_t target = read(targetAddr);
-        carry = !!(target & 0x80);
+        uint8_t target = read(addr);
+        r.carry = !!(target & 0x80);
         result = target << 1;
-        write(targetAddr, result);
+        write(addr, result);
     }
-    zero = (result == 0);
-    negative = !!(result & 0x80);
+    setZN(r, result);
 }
 
-void CPU::OpBCC()
+template <class Bus>
+int CPU<Bus>::OpBCC(Registers &r, uint16_t addr)
 {
-    if(!carry) {
-        branch();
+    if(!r.carry) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpBCS()
+template <class Bus>
+int CPU<Bus>::OpBCS(Registers &r, uint16_t addr)
 {
-    if(carry) {
-        branch();
+    if(r.carry) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpBEQ()
+template <class Bus>
+int CPU<Bus>::OpBEQ(Registers &r, uint16_t addr)
 {
-    if(zero) {
-        branch();
+    if(getZero(r)) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpBIT()
+template <class Bus>
+void CPU<Bus>::OpBIT(Registers &r, uint16_t addr)
 {
-    uint8_t fetched = read(targetAddr);
-    uint8_t result = acc & fetched;
-    zero = (result == 0);
-    overflow = !!(fetched & 0x40);
-    negative = !!(fetched & 0x80);
+    uint8_t fetched = read(addr);
+    uint8_t result = r.acc & fetched;
+    setZero(r, result);
+    r.overflow = !!(fetched & 0x40);
+    setNegative(r, fetched);
 }
 
-void CPU::OpBMI()
+template <class Bus>
+int CPU<Bus>::OpBMI(Registers &r, uint16_t addr)
 {
-    if(negative) {
-        branch();
+    if(getNegative(r)) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpBNE()
+template <class Bus>
+int CPU<Bus>::OpBNE(Registers &r, uint16_t addr)
 {
-    if(!zero) {
-        branch();
+    if(!getZero(r)) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpBPL()
+template <class Bus>
+int CPU<Bus>::OpBPL(Registers &r, uint16_t addr)
 {
-    if(!negative) {
-        branch();
+    if(!getNegative(r)) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpBRK()
+template <class Bus>
+void CPU<Bus>::OpBRK(Registers &r, uint16_t addr)
 {
-    push16(pc+1);
-    push8(getStatus() | 0x10);
-    intdisable = 1;
-    pc = loadAddr(IRQ_VECTOR);
+    push16(r, r.pc+1);
+    push8(r, getStatus(r) | 0x10);
+    r.intdisable = 1;
+    r.pc = loadAddr(IRQ_VECTOR);
 }
 
-void CPU::OpBVC()
+template <class Bus>
+int CPU<Bus>::OpBVC(Registers &r, uint16_t addr)
 {
-    if(!overflow) {
-        branch();
+    if(!r.overflow) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpBVS()
+template <class Bus>
+int CPU<Bus>::OpBVS(Registers &r, uint16_t addr)
 {
-    if(overflow) {
-        branch();
+    if(r.overflow) {
+        return branch(r, addr);
     }
+    return 0;
 }
 
-void CPU::OpCLC()
+template <class Bus>
+void CPU<Bus>::OpCLC(Registers &r, uint16_t addr)
 {
-    carry = 0;
+    r.carry = 0;
 }
 
-void CPU::OpCLD()
+template <class Bus>
+void CPU<Bus>::OpCLD(Registers &r, uint16_t addr)
 {
-    decmode = 0;
+    r.decmode = 0;
 }
 
-void CPU::OpCLI()
+template <class Bus>
+void CPU<Bus>::OpCLI(Registers &r, uint16_t addr)
 {
-    intdisable = 0;
+    r.intdisable = 0;
 }
 
-void CPU::OpCLV()
+template <class Bus>
+void CPU<Bus>::OpCLV(Registers &r, uint16_t addr)
 {
-    overflow = 0;
+    r.overflow = 0;
 }
 
-void CPU::OpCMP()
+template <class Bus>
+void CPU<Bus>::OpCMP(Registers &r, uint16_t addr)
 {
-    uint8_t fetched = read(targetAddr);
-    uint8_t result = acc - fetched;
-    carry = acc >= fetched;
-    zero = acc == fetched;
-    negative = !!(result & 0x80);
+    uint8_t fetched = read(addr);
+    uint8_t result = r.acc - fetched;
+    r.carry = r.acc >= fetched;
+    setZN(r, result);
 }
 
-void CPU::OpCPX()
+template <class Bus>
+void CPU<Bus>::OpCPX(Registers &r, uint16_t addr)
 {
-    uint8_t fetched = read(targetAddr);
-    uint8_t result = x - fetched;
-    carry = x >= fetched;
-    zero = x == fetched;
-    negative = !!(result & 0x80);
+    uint8_t fetched = read(addr);
+    uint8_t result = r.x - fetched;
+    r.carry = r.x >= fetched;
+    setZN(r, result);
 }
 
-void CPU::OpCPY()
+template <class Bus>
+void CPU<Bus>::OpCPY(Registers &r, uint16_t addr)
 {
-    uint8_t fetched = read(targetAddr);
-    uint8_t result = y - fetched;
-    carry = y >= fetched;
-    zero = y == fetched;
-    negative = !!(result & 0x80);
+    uint8_t fetched = read(addr);
+    uint8_t result = r.y - fetched;
+    r.carry = r.y >= fetched;
+    setZN(r, result);
 }
 
-void CPU::OpDEC()
+template <class Bus>
+void CPU<Bus>::OpDEC(Registers &r, uint16_t addr)
 {
-    uint8_t result = read(targetAddr) - 1;
-    write(targetAddr, result);
-    zero = result == 0;
-    negative = !!(result & 0x80);
+    uint8_t result = read(addr) - 1;
+    write(addr, result);
+    setZN(r, result);
 }
 
-void CPU::OpDEX()
+template <class Bus>
+void CPU<Bus>::OpDEX(Registers &r, uint16_t addr)
 {
-    x = x - 1;
-    zero = x == 0;
-    negative = !!(x & 0x80);
+    r.x = r.x - 1;
+    setZN(r, r.x);
 }
 
-void CPU::OpDEY()
+template <class Bus>
+void CPU<Bus>::OpDEY(Registers &r, uint16_t addr)
 {
-    y = y - 1;
-    zero = y == 0;
-    negative = !!(y & 0x80);
+    r.y = r.y - 1;
+    setZN(r, r.y);
 }
 
-void CPU::OpEOR()
+template <class Bus>
+void CPU<Bus>::OpEOR(Registers &r, uint16_t addr)
 {
-    acc = acc ^ read(targetAddr);
-    zero = acc == 0;
-    negative = !!(acc & 0x80);
+    r.acc = r.acc ^ read(addr);
+    setZN(r, r.acc);
 }
 
-void CPU::OpINC()
+template <class Bus>
+void CPU<Bus>::OpINC(Registers &r, uint16_t addr)
 {
-    uint8_t result = read(targetAddr) + 1;
-    write(targetAddr, result);
-    zero = result == 0;
-    negative = !!(result & 0x80);
+    uint8_t result = read(addr) + 1;
+    write(addr, result);
+    setZN(r, result);
 }
 
-void CPU::OpINX()
+template <class Bus>
+void CPU<Bus>::OpINX(Registers &r, uint16_t addr)
 {
-    x = x + 1;
-    zero = x == 0;
-    negative = !!(x & 0x80);
+    r.x = r.x + 1;
+    setZN(r, r.x);
 }
 
-void CPU::OpINY()
+template <class Bus>
+void CPU<Bus>::OpINY(Registers &r, uint16_t addr)
 {
-    y = y + 1;
-    zero = y == 0;
-    negative = !!(y & 0x80);
+    r.y = r.y + 1;
+    setZN(r, r.y);
 }
 
-void CPU::OpJMP()
+template <class Bus>
+void CPU<Bus>::OpJMP(Registers &r, uint16_t addr)
 {
-    pc = targetAddr;
+    r.pc = addr;
 }
 
-void CPU::OpJSR()
+template <class Bus>
+void CPU<Bus>::OpJSR(Registers &r, uint16_t addr)
 {
-    push16(pc - 1);
-    pc = targetAddr;
+    push16(r, r.pc - 1);
+    r.pc = addr;
 }
 
-void CPU::OpLDA()
+template <class Bus>
+void CPU<Bus>::OpLDA(Registers &r, uint16_t addr)
 {
-    acc = read(targetAddr);
-    zero = acc == 0;
-    negative = !!(acc & 0x80);
+    r.acc = read(addr);
+    setZN(r, r.acc);
 }
 
-void CPU::OpLDX()
+template <class Bus>
+void CPU<Bus>::OpLDX(Registers &r, uint16_t addr)
 {
-    x = read(targetAddr);
-    zero = x == 0;
-    negative = !!(x & 0x80);
+    r.x = read(addr);
+    setZN(r, r.x);
 }
 
-void CPU::OpLDY()
+template <class Bus>
+void CPU<Bus>::OpLDY(Registers &r, uint16_t addr)
 {
-    y = read(targetAddr);
-    zero = y == 0;
-    negative = !!(y & 0x80);
+    r.y = read(addr);
+    setZN(r, r.y);
 }
 
-void CPU::OpLSR()
+template <class Bus>
+void CPU<Bus>::OpLSR(Registers &r, uint16_t addr, bool useAcc)
 {
     uint8_t result = 0;
     if(useAcc) {
-        carry = !!(acc & 0x01);
-        result = acc >> 1;
-        acc = result;
-        useAcc = 0;
+        r.carry = !!(r.acc & 0x01);
+        result = r.acc >> 1;
+        r.acc = result;
     } else {
-        uint8_t target = read(targetAddr);
-        carry = !!(target & 0x01);
+        uint8_t target = read(addr);
+        r.carry = !!(target & 0x01);
         result = target >> 1;
-        write(targetAddr, result);
+        write(addr, result);
     }
-    zero = result == 0;
-    negative = !!(result & 0x80);
+    setZN(r, result);
 }
 
-void CPU::OpNOP() { }
+template <class Bus>
+void CPU<Bus>::OpNOP(Registers &r, uint16_t addr) { }
 
-void CPU::OpORA()
+template <class Bus>
+void CPU<Bus>::OpORA(Registers &r, uint16_t addr)
 {
-    acc = acc | read(targetAddr);
-    zero = acc == 0;
-    negative = !!(acc & 0x80);
+    r.acc = r.acc | read(addr);
+    setZN(r, r.acc);
 }
 
-void CPU::OpPHA()
+template <class Bus>
+void CPU<Bus>::OpPHA(Registers &r, uint16_t addr)
 {
-    push8(acc);
+    push8(r, r.acc);
 }
 
-void CPU::OpPHP()
+template <class Bus>
+void CPU<Bus>::OpPHP(Registers &r, uint16_t addr)
 {
-    push8(getStatus() | 0x10);
+    push8(r, getStatus(r) | 0x10);
 }
 
-void CPU::OpPLA()
+template <class Bus>
+void CPU<Bus>::OpPLA(Registers &r, uint16_t addr)
 {
-    acc = pop8();
-    zero = acc == 0;
-    negative = !!(acc & 0x80);
+    r.acc = pop8(r);
+    setZN(r, r.acc);
 }
 
-void CPU::OpPLP()
+template <class Bus>
+void CPU<Bus>::OpPLP(Registers &r, uint16_t addr)
 {
-    setStatus(pop8() & 0xEF);
+    setStatus(r, pop8(r) & 0xEF);
 }
 
-void CPU::OpROL()
+template <class Bus>
+void CPU<Bus>::OpROL(Registers &r, uint16_t addr, bool useAcc)
 {
     uint8_t result = 0;
     if(useAcc) {
-        result = (acc << 1) | (carry ? 1 : 0);
-        carry = !!(acc & 0x80);
-        acc = result;
-        useAcc = 0;
+        result = (r.acc << 1) | (r.carry ? 1 : 0);
+        r.carry = !!(r.acc & 0x80);
+        r.acc = result;
     } else {
-        uint8_t target = read(targetAddr);
-        result = (target << 1) | (carry ? 1 : 0);
-        carry = !!(target & 0x80);
-        write(targetAddr, result);
+        uint8_t target = read(addr);
+        result = (target << 1) | (r.carry ? 1 : 0);
+        r.carry = !!(target & 0x80);
+        write(addr, result);
     }
-    zero = result == 0;
-    negative = !!(result & 0x80);
+    setZN(r, result);
 }
 
-void CPU::OpROR()
+template <class Bus>
+void CPU<Bus>::OpROR(Registers &r, uint16_t addr, bool useAcc)
 {
     uint8_t result = 0;
     if(useAcc) {
-        result = (acc >> 1) | (carry ? 0x80 : 0);
-        carry = !!(acc & 0x01);
-        acc = result;
-        useAcc = 0;
+        result = (r.acc >> 1) | (r.carry ? 0x80 : 0);
+        r.carry = !!(r.acc & 0x01);
+        r.acc = result;
     } else {
-        uint8_t target = read(targetAddr);
-        result = (target >> 1) | (carry ? 0x80 : 0);
-        carry = !!(target & 0x01);
-        write(targetAddr, result);
+        uint8_t target = read(addr);
+        result = (target >> 1) | (r.carry ? 0x80 : 0);
+        r.carry = !!(target & 0x01);
+        write(addr, result);
     }
-    zero = result == 0;
-    negative = !!(result & 0x80);
+    setZN(r, result);
 }
 
-void CPU::OpRTI()
+template <class Bus>
+void CPU<Bus>::OpRTI(Registers &r, uint16_t addr)
 {
-    setStatus(pop8() & 0xEF);
-    pc = pop16();
+    setStatus(r, pop8(r) & 0xEF);
+    r.pc = pop16(r);
 }
 
-void CPU::OpRTS()
+template <class Bus>
+void CPU<Bus>::OpRTS(Registers &r, uint16_t addr)
 {
-    pc = pop16() + 1;
+    r.pc = pop16(r) + 1;
 }
 
-void CPU::OpSBC()
+template <class Bus>
+void CPU<Bus>::OpSBC(Registers &r, uint16_t addr)
 {
-    uint8_t memAdd = read(targetAddr) ^ 0xFF;
-    uint16_t tempAcc = acc + memAdd + (carry ? 1 : 0);
-    zero = (tempAcc & 0xFF) == 0;
-    negative = !!(tempAcc & 0x80);
-    carry = (tempAcc >> 8) != 0;
-    overflow = (((acc ^ tempAcc) & (memAdd ^ tempAcc)) & 0x80) != 0;
-    acc = (uint8_t)(tempAcc & 0xFF);
+    uint8_t memAdd = read(addr) ^ 0xFF;
+    uint16_t tempAcc = r.acc + memAdd + (r.carry ? 1 : 0);
+    setZN(r, tempAcc);
+    r.carry = (tempAcc >> 8) != 0;
+    r.overflow = (((r.acc ^ tempAcc) & (memAdd ^ tempAcc)) & 0x80) != 0;
+    r.acc = (uint8_t)(tempAcc & 0xFF);
 }
 
-void CPU::OpSEC()
+template <class Bus>
+void CPU<Bus>::OpSEC(Registers &r, uint16_t addr)
 {
-    carry = 1;
+    r.carry = 1;
 }
 
-void CPU::OpSED()
+template <class Bus>
+void CPU<Bus>::OpSED(Registers &r, uint16_t addr)
 {
-    decmode = 1;
+    r.decmode = 1;
 }
 
-void CPU::OpSEI()
+template <class Bus>
+void CPU<Bus>::OpSEI(Registers &r, uint16_t addr)
 {
-    intdisable = 1;
+    r.intdisable = 1;
 }
 
-void CPU::OpSTA()
+template <class Bus>
+void CPU<Bus>::OpSTA(Registers &r, uint16_t addr)
 {
-    write(targetAddr, acc);
+    write(addr, r.acc);
 }
 
-void CPU::OpSTX()
+template <class Bus>
+void CPU<Bus>::OpSTX(Registers &r, uint16_t addr)
 {
-    write(targetAddr, x);
+    write(addr, r.x);
 }
 
-void CPU::OpSTY()
+template <class Bus>
+void CPU<Bus>::OpSTY(Registers &r, uint16_t addr)
 {
-    write(targetAddr, y);
+    write(addr, r.y);
 }
 
-void CPU::OpTAX()
+template <class Bus>
+void CPU<Bus>::OpTAX(Registers &r, uint16_t addr)
 {
-    x = acc;
-    zero = x == 0;
-    negative = !!(x & 0x80);
+    r.x = r.acc;
+    setZN(r, r.x);
 }
 
-void CPU::OpTAY()
+template <class Bus>
+void CPU<Bus>::OpTAY(Registers &r, uint16_t addr)
 {
-    y = acc;
-    zero = y == 0;
-    negative = !!(y & 0x80);
+    r.y = r.acc;
+    setZN(r, r.y);
 }
 
-void CPU::OpTSX()
+template <class Bus>
+void CPU<Bus>::OpTSX(Registers &r, uint16_t addr)
 {
-    x = sp;
-    zero = sp == 0;
-    negative = !!(sp & 0x80);
+    r.x = r.sp;
+    setZN(r, r.sp);
 }
 
-void CPU::OpTXA()
+template <class Bus>
+void CPU<Bus>::OpTXA(Registers &r, uint16_t addr)
 {
-    acc = x;
-    zero = acc == 0;
-    negative = !!(acc & 0x80);
+    r.acc = r.x;
+    setZN(r, r.acc);
 }
 
-void CPU::OpTXS()
+template <class Bus>
+void CPU<Bus>::OpTXS(Registers &r, uint16_t addr)
 {
-    sp = x;
+    r.sp = r.x;
 }
 
-void CPU::OpTYA()
+template <class Bus>
+void CPU<Bus>::OpTYA(Registers &r, uint16_t addr)
 {
-    acc = y;
-    zero = acc == 0;
-    negative = !!(acc & 0x80);
+    r.acc = r.y;
+    setZN(r, r.acc);
 }
 
 /* Undocumented Ops */
 
-void CPU::OpJAM() { }
-void CPU::OpSLO() { }
-void CPU::OpDOP() { }
-void CPU::OpANC() { }
-void CPU::OpTOP() { }
-void CPU::OpRLA() { }
-void CPU::OpSRE() { }
-void CPU::OpALR() { }
-void CPU::OpRRA() { }
-void CPU::OpARR() { }
-void CPU::OpSAX() { }
-void CPU::OpXAA() { }
-void CPU::OpAHX() { }
-void CPU::OpXAS() { }
-void CPU::OpSHY() { }
-void CPU::OpSHX() { }
-void CPU::OpLAX() { }
-void CPU::OpLAR() { }
-void CPU::OpDCP() { }
-void CPU::OpAXS() { }
-void CPU::OpISC() { }
+template <class Bus>
+void CPU<Bus>::OpJAM(Registers &r, uint16_t addr)
+{
+    jammed = 1;
+}
+template <class Bus>
+void CPU<Bus>::OpSLO(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpDOP(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpANC(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpTOP(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpRLA(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpSRE(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpALR(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpRRA(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpARR(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpSAX(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpXAA(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpAHX(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpXAS(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpSHY(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpSHX(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpLAX(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpLAR(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpDCP(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpAXS(Registers &r, uint16_t addr) { }
+template <class Bus>
+void CPU<Bus>::OpISC(Registers &r, uint16_t addr) { }
 
 /* Address Modes */
 
-void CPU::AmABS()
+// operand is the one or two bytes following the opcode, see fetchOperand()
+
+template <class Bus>
+uint16_t CPU<Bus>::AmABS(Registers &r, uint16_t operand)
 {
-    targetAddr = loadAddr(pc + 1);
-    pc += 3;
+    r.pc += 3;
+    return operand;
 }
 
-void CPU::AmABX()
+template <class Bus>
+uint16_t CPU<Bus>::AmABX(Registers &r, uint16_t operand)
 {
-    targetAddr = loadAddr(pc + 1) + x;
-    pc += 3;
+    r.pc += 3;
+    return operand + r.x;
 }
 
-void CPU::AmABX_C()
+template <class Bus>
+uint16_t CPU<Bus>::AmABX_C(Registers &r, uint16_t operand, int &cycles)
 {
-    uint8_t low = read(pc + 1) + x;
-    uint8_t high = read(pc + 2);
-    targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-    if(low < x) { // page boundary crossed
-        read(targetAddr); // dummy read
+    uint8_t low = (operand & 0xFF) + r.x;
+    uint8_t high = operand >> 8;
+    uint16_t addr = (uint16_t)low | ((uint16_t)high << 8);
+    if(low < r.x) { // page boundary crossed
+        read(addr); // dummy read
         high += 1;
-        targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-        suspend(1);
+        addr = (uint16_t)low | ((uint16_t)high << 8);
+        cycles += 1;
     }
-    pc += 3;
+    r.pc += 3;
+    return addr;
 }
 
-void CPU::AmABY()
+template <class Bus>
+uint16_t CPU<Bus>::AmABY(Registers &r, uint16_t operand)
 {
-    targetAddr = loadAddr(pc + 1) + y;
-    pc += 3;
+    r.pc += 3;
+    return operand + r.y;
 }
 
-void CPU::AmABY_C()
+template <class Bus>
+uint16_t CPU<Bus>::AmABY_C(Registers &r, uint16_t operand, int &cycles)
 {
-    uint8_t low = read(pc + 1) + y;
-    uint8_t high = read(pc + 2);
-    targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-    if(low < y) { // page boundary crossed
-        read(targetAddr); // dummy read
+    uint8_t low = (operand & 0xFF) + r.y;
+    uint8_t high = operand >> 8;
+    uint16_t addr = (uint16_t)low | ((uint16_t)high << 8);
+    if(low < r.y) { // page boundary crossed
+        read(addr); // dummy read
         high += 1;
-        targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-        suspend(1);
+        addr = (uint16_t)low | ((uint16_t)high << 8);
+        cycles += 1;
     }
-    pc += 3;
+    r.pc += 3;
+    return addr;
 }
 
-void CPU::AmACC()
+template <class Bus>
+uint16_t CPU<Bus>::AmACC(Registers &r)
 {
-    useAcc = 1;
-    pc += 1;
+    r.pc += 1;
+    return 0;
 }
 
-void CPU::AmIMM()
+template <class Bus>
+uint16_t CPU<Bus>::AmIMM(Registers &r)
 {
-    targetAddr = pc + 1;
-    pc += 2;
+    uint16_t addr = r.pc + 1;
+    r.pc += 2;
+    return addr;
 }
 
-void CPU::AmIMP()
+template <class Bus>
+uint16_t CPU<Bus>::AmIMP(Registers &r)
 {
-    pc += 1;
+    r.pc += 1;
+    return 0;
 }
 
-void CPU::AmIND()
+template <class Bus>
+uint16_t CPU<Bus>::AmIND(Registers &r, uint16_t operand)
 {
-    uint16_t addrOperand = loadAddr(pc + 1);
-    if((addrOperand & 0xFF) == 0xFF) { // force low byte to wrap
-        uint8_t low = read(addrOperand);
-        uint8_t high = read(addrOperand - 0xFF);
-        targetAddr = (uint16_t)low | ((uint16_t)high << 8);
+    uint16_t addr;
+    if((operand & 0xFF) == 0xFF) { // force low byte to wrap
+        uint8_t low = read(operand);
+        uint8_t high = read(operand - 0xFF);
+        addr = (uint16_t)low | ((uint16_t)high << 8);
     } else {
-        targetAddr = loadAddr(addrOperand);
+        addr = loadAddr(operand);
     }
-    pc += 1; // no effect since only used for OpJMP()
+    r.pc += 1; // no effect since only used for OpJMP(r)
+    return addr;
 }
 
-void CPU::AmINX()
+template <class Bus>
+uint16_t CPU<Bus>::AmINX(Registers &r, uint16_t operand)
 {
-    uint8_t addrOperand = x + read(pc + 1);
+    uint8_t addrOperand = r.x + operand;
     // below is a modified loadAddr() such that
     // addrOperand wraps to the zero page
     uint8_t low = read(addrOperand);
     addrOperand += 1;
     uint8_t high = read(addrOperand);
-    targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-    pc += 2;
+    uint16_t addr = (uint16_t)low | ((uint16_t)high << 8);
+    r.pc += 2;
+    return addr;
 }
 
-void CPU::AmINY()
+template <class Bus>
+uint16_t CPU<Bus>::AmINY(Registers &r, uint16_t operand)
 {
-    uint8_t addrOperand = read(pc + 1);
-    uint8_t low = read(addrOperand) + y;
+    uint8_t addrOperand = operand;
+    uint8_t low = read(addrOperand) + r.y;
     addrOperand += 1;
     uint8_t high = read(addrOperand);
-    targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-    if(low < y) { // page boundary crossed
+    uint16_t addr = (uint16_t)low | ((uint16_t)high << 8);
+    if(low < r.y) { // page boundary crossed
         high += 1;
-        targetAddr = (uint16_t)low | ((uint16_t)high << 8);
+        addr = (uint16_t)low | ((uint16_t)high << 8);
     }
-    pc += 2;
+    r.pc += 2;
+    return addr;
 }
 
-void CPU::AmINY_C()
+template <class Bus>
+uint16_t CPU<Bus>::AmINY_C(Registers &r, uint16_t operand, int &cycles)
 {
-    uint8_t addrOperand = read(pc + 1);
-    uint8_t low = read(addrOperand) + y;
+    uint8_t addrOperand = operand;
+    uint8_t low = read(addrOperand) + r.y;
     addrOperand += 1;
     uint8_t high = read(addrOperand);
-    targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-    if(low < y) { // page boundary crossed
-        read(targetAddr); // dummy read
+    uint16_t addr = (uint16_t)low | ((uint16_t)high << 8);
+    if(low < r.y) { // page boundary crossed
+        read(addr); // dummy read
         high += 1;
-        targetAddr = (uint16_t)low | ((uint16_t)high << 8);
-        suspend(1);
+        addr = (uint16_t)low | ((uint16_t)high << 8);
+        cycles += 1;
     }
-    pc += 2;
+    r.pc += 2;
+    return addr;
+}
+
+template <class Bus>
+uint16_t CPU<Bus>::AmREL(Registers &r, uint16_t operand)
+{
+    // the offset is stored as a signed byte, relative to the next opcode
+    r.pc += 2;
+    return r.pc + (int8_t)operand;
 }
 
-void CPU::AmZPG()
+template <class Bus>
+uint16_t CPU<Bus>::AmZPG(Registers &r, uint16_t operand)
 {
-    targetAddr = read(pc + 1);
-    pc += 2;
+    r.pc += 2;
+    return operand & 0xFF;
 }
 
-void CPU::AmZPX()
+template <class Bus>
+uint16_t CPU<Bus>::AmZPX(Registers &r, uint16_t operand)
 {
-    uint8_t addr = read(pc + 1) + x;
-    targetAddr = addr;
-    pc += 2;
+    uint8_t addr = operand + r.x;
+    r.pc += 2;
+    return addr;
 }
 
-void CPU::AmZPY()
+template <class Bus>
+uint16_t CPU<Bus>::AmZPY(Registers &r, uint16_t operand)
 {
-    uint8_t addr = read(pc + 1) + y;
-    targetAddr = addr;
-    pc += 2;
+    uint8_t addr = operand + r.y;
+    r.pc += 2;
+    return addr;
 }
 
-void CPU::runInstr(uint8_t opCode)
+/* Dispatch */
+
+template <class Bus>
+uint16_t CPU<Bus>::fetchOperand(Registers &r, AddrMode mode)
 {
+    if(mode == AM_IMM) {
+        return 0; // read through the bus from pc + 1 by the instruction
+    }
+    switch(getOperandLength(mode)) {
+        case 1: return read(r.pc + 1);
+        case 2: return loadAddr(r.pc + 1);
+    }
+    return 0;
+}
+
+template <class Bus>
+uint16_t CPU<Bus>::address(Registers &r, AddrMode mode, bool pageCrossPenalty, uint16_t operand, int &cycles)
+{
+    switch(mode) {
+        case AM_ABS: return AmABS(r, operand);
+        case AM_ABX: return pageCrossPenalty ? AmABX_C(r, operand, cycles) : AmABX(r, operand);
+        case AM_ABY: return pageCrossPenalty ? AmABY_C(r, operand, cycles) : AmABY(r, operand);
+        case AM_ACC: return AmACC(r);
+        case AM_IMM: return AmIMM(r);
+        case AM_IMP: return AmIMP(r);
+        case AM_IND: return AmIND(r, operand);
+        case AM_INX: return AmINX(r, operand);
+        case AM_INY: return pageCrossPenalty ? AmINY_C(r, operand, cycles) : AmINY(r, operand);
+        case AM_REL: return AmREL(r, operand);
+        case AM_ZPG: return AmZPG(r, operand);
+        case AM_ZPX: return AmZPX(r, operand);
+        case AM_ZPY: return AmZPY(r, operand);
+    }
+    return 0;
+}
+
+template <class Bus>
+int CPU<Bus>::operate(Registers &r, Operation operation, AddrMode mode, uint16_t addr)
+{
+    switch(operation) {
+        case OP_ADC: OpADC(r, addr); return 0;
+        case OP_AND: OpAND(r, addr); return 0;
+        case OP_ASL: OpASL(r, addr, mode == AM_ACC); return 0;
+        case OP_BRK: OpBRK(r, addr); return 0;
+        case OP_BCC: return OpBCC(r, addr);
+        case OP_BCS: return OpBCS(r, addr);
+        case OP_BEQ: return OpBEQ(r, addr);
+        case OP_BIT: OpBIT(r, addr); return 0;
+        case OP_BMI: return OpBMI(r, addr);
+        case OP_BNE: return OpBNE(r, addr);
+        case OP_BPL: return OpBPL(r, addr);
+        case OP_BVC: return OpBVC(r, addr);
+        case OP_BVS: return OpBVS(r, addr);
+        case OP_CLC: OpCLC(r, addr); return 0;
+        case OP_CLD: OpCLD(r, addr); return 0;
+        case OP_CLI: OpCLI(r, addr); return 0;
+        case OP_CLV: OpCLV(r, addr); return 0;
+        case OP_CMP: OpCMP(r, addr); return 0;
+        case OP_CPX: OpCPX(r, addr); return 0;
+        case OP_CPY: OpCPY(r, addr); return 0;
+        case OP_DEC: OpDEC(r, addr); return 0;
+        case OP_DEX: OpDEX(r, addr); return 0;
+        case OP_DEY: OpDEY(r, addr); return 0;
+        case OP_EOR: OpEOR(r, addr); return 0;
+        case OP_INC: OpINC(r, addr); return 0;
+        case OP_INX: OpINX(r, addr); return 0;
+        case OP_INY: OpINY(r, addr); return 0;
+        case OP_JMP: OpJMP(r, addr); return 0;
+        case OP_JSR: OpJSR(r, addr); return 0;
+        case OP_LDA: OpLDA(r, addr); return 0;
+        case OP_LDX: OpLDX(r, addr); return 0;
+        case OP_LDY: OpLDY(r, addr); return 0;
+        case OP_LSR: OpLSR(r, addr, mode == AM_ACC); return 0;
+        case OP_NOP: OpNOP(r, addr); return 0;
+        case OP_ORA: OpORA(r, addr); return 0;
+        case OP_PHA: OpPHA(r, addr); return 0;
+        case OP_PHP: OpPHP(r, addr); return 0;
+        case OP_PLA: OpPLA(r, addr); return 0;
+        case OP_PLP: OpPLP(r, addr); return 0;
+        case OP_ROL: OpROL(r, addr, mode == AM_ACC); return 0;
+        case OP_ROR: OpROR(r, addr, mode == AM_ACC); return 0;
+        case OP_RTI: OpRTI(r, addr); return 0;
+        case OP_RTS: OpRTS(r, addr); return 0;
+        case OP_SBC: OpSBC(r, addr); return 0;
+        case OP_SEC: OpSEC(r, addr); return 0;
+        case OP_SED: OpSED(r, addr); return 0;
+        case OP_SEI: OpSEI(r, addr); return 0;
+        case OP_STA: OpSTA(r, addr); return 0;
+        case OP_STX: OpSTX(r, addr); return 0;
+        case OP_STY: OpSTY(r, addr); return 0;
+        case OP_TAX: OpTAX(r, addr); return 0;
+        case OP_TAY: OpTAY(r, addr); return 0;
+        case OP_TSX: OpTSX(r, addr); return 0;
+        case OP_TXA: OpTXA(r, addr); return 0;
+        case OP_TXS: OpTXS(r, addr); return 0;
+        case OP_TYA: OpTYA(r, addr); return 0;
+        case OP_JAM: OpJAM(r, addr); return 0;
+        case OP_SLO: OpSLO(r, addr); return 0;
+        case OP_DOP: OpDOP(r, addr); return 0;
+        case OP_ANC: OpANC(r, addr); return 0;
+        case OP_TOP: OpTOP(r, addr); return 0;
+        case OP_RLA: OpRLA(r, addr); return 0;
+        case OP_SRE: OpSRE(r, addr); return 0;
+        case OP_ALR: OpALR(r, addr); return 0;
+        case OP_RRA: OpRRA(r, addr); return 0;
+        case OP_ARR: OpARR(r, addr); return 0;
+        case OP_SAX: OpSAX(r, addr); return 0;
+        case OP_XAA: OpXAA(r, addr); return 0;
+        case OP_AHX: OpAHX(r, addr); return 0;
+        case OP_XAS: OpXAS(r, addr); return 0;
+        case OP_SHY: OpSHY(r, addr); return 0;
+        case OP_SHX: OpSHX(r, addr); return 0;
+        case OP_LAX: OpLAX(r, addr); return 0;
+        case OP_LAR: OpLAR(r, addr); return 0;
+        case OP_DCP: OpDCP(r, addr); return 0;
+        case OP_AXS: OpAXS(r, addr); return 0;
+        case OP_ISC: OpISC(r, addr); return 0;
+    }
+    return 0;
+}
+
+template <class Bus>
+template <uint8_t OPCODE>
+int CPU<Bus>::execute(Registers &r, uint16_t operand)
+{
+    // every argument here is a constant, so the switches in address()
+    // and operate() fold away leaving just the one mode and operation
+    constexpr Opcode opcode = OPCODES[OPCODE];
+    int cycles = opcode.cycles;
+    uint16_t addr = address(r, opcode.mode, opcode.pageCrossPenalty, operand, cycles);
+    instrCycles = cycles;
+    cycles += operate(r, opcode.operation, opcode.mode, addr);
+    return cycles;
+}
+
+template <class Bus>
+int CPU<Bus>::executeUnfused(Registers &r, uint8_t opCode, uint16_t operand)
+{
+    const Opcode &opcode = OPCODES[opCode];
+    int cycles = opcode.cycles;
+    uint16_t addr = address(r, opcode.mode, opcode.pageCrossPenalty, operand, cycles);
+    instrCycles = cycles;
+    cycles += operate(r, opcode.operation, opcode.mode, addr);
+    return cycles;
+}
+
+// expand F(n) for every opcode n
+#define OPCODES_16(F, n) \
+    F(n + 0x0) F(n + 0x1) F(n + 0x2) F(n + 0x3) F(n + 0x4) F(n + 0x5) F(n + 0x6) F(n + 0x7) \
+    F(n + 0x8) F(n + 0x9) F(n + 0xA) F(n + 0xB) F(n + 0xC) F(n + 0xD) F(n + 0xE) F(n + 0xF)
+#define OPCODES_256(F) \
+    OPCODES_16(F, 0x00) OPCODES_16(F, 0x10) OPCODES_16(F, 0x20) OPCODES_16(F, 0x30) \
+    OPCODES_16(F, 0x40) OPCODES_16(F, 0x50) OPCODES_16(F, 0x60) OPCODES_16(F, 0x70) \
+    OPCODES_16(F, 0x80) OPCODES_16(F, 0x90) OPCODES_16(F, 0xA0) OPCODES_16(F, 0xB0) \
+    OPCODES_16(F, 0xC0) OPCODES_16(F, 0xD0) OPCODES_16(F, 0xE0) OPCODES_16(F, 0xF0)
+
+// OPCODE_OPERAND(n) is defined by each switch below
+#define OPCODE_CASE(n) case (n): return execute<(n)>(r, OPCODE_OPERAND(n));
+
+template <class Bus>
+int CPU<Bus>::runInstr(Registers &r, uint8_t opCode)
+{
+#ifdef CPU_SWITCH_DISPATCH
+    // decode the table entry at run time, switching on the address mode
+    // and then on the operation; kept as a baseline for benchmarking
+    return executeUnfused(r, opCode, fetchOperand(r, OPCODES[opCode].mode));
+#else
+    // a dense switch, which compiles to a single jump table indexed by
+    // opcode straight into each fused handler
+#define OPCODE_OPERAND(n) fetchOperand(r, OPCODES[n].mode)
     switch(opCode) {
-        case (0x00): AmIMP();   OpBRK(); suspend(7); break;
-        case (0x01): AmINX();   OpORA(); suspend(6); break;
-        case (0x02): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x03): AmINX();   OpSLO(); suspend(8); break;
-        case (0x04): AmZPG();   OpDOP(); suspend(3); break;
-        case (0x05): AmZPG();   OpORA(); suspend(3); break;
-        case (0x06): AmZPG();   OpASL(); suspend(5); break;
-        case (0x07): AmZPG();   OpSLO(); suspend(5); break;
-        case (0x08): AmIMP();   OpPHP(); suspend(3); break;
-        case (0x09): AmIMM();   OpORA(); suspend(2); break;
-        case (0x0A): AmACC();   OpASL(); suspend(2); break;
-        case (0x0B): AmIMM();   OpANC(); suspend(2); break;
-        case (0x0C): AmABS();   OpTOP(); suspend(4); break;
-        case (0x0D): AmABS();   OpORA(); suspend(4); break;
-        case (0x0E): AmABS();   OpASL(); suspend(6); break;
-        case (0x0F): AmABS();   OpSLO(); suspend(6); break;
-        case (0x10): AmIMM();   OpBPL(); suspend(2); break;
-        case (0x11): AmINY_C(); OpORA(); suspend(5); break;
-        case (0x12): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x13): AmINY();   OpSLO(); suspend(8); break;
-        case (0x14): AmZPX();   OpDOP(); suspend(4); break;
-        case (0x15): AmZPX();   OpORA(); suspend(4); break;
-        case (0x16): AmZPX();   OpASL(); suspend(6); break;
-        case (0x17): AmZPX();   OpSLO(); suspend(6); break;
-        case (0x18): AmIMP();   OpCLC(); suspend(2); break;
-        case (0x19): AmABY_C(); OpORA(); suspend(4); break;
-        case (0x1A): AmIMP();   OpNOP(); suspend(2); break;
-        case (0x1B): AmABY();   OpSLO(); suspend(7); break;
-        case (0x1C): AmABX_C(); OpTOP(); suspend(4); break;
-        case (0x1D): AmABX_C(); OpORA(); suspend(4); break;
-        case (0x1E): AmABX();   OpASL(); suspend(7); break;
-        case (0x1F): AmABX();   OpSLO(); suspend(7); break;
-        case (0x20): AmABS();   OpJSR(); suspend(6); break;
-        case (0x21): AmINX();   OpAND(); suspend(6); break;
-        case (0x22): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x23): AmINX();   OpRLA(); suspend(8); break;
-        case (0x24): AmZPG();   OpBIT(); suspend(3); break;
-        case (0x25): AmZPG();   OpAND(); suspend(3); break;
-        case (0x26): AmZPG();   OpROL(); suspend(5); break;
-        case (0x27): AmZPG();   OpRLA(); suspend(5); break;
-        case (0x28): AmIMP();   OpPLP(); suspend(4); break;
-        case (0x29): AmIMM();   OpAND(); suspend(2); break;
-        case (0x2A): AmACC();   OpROL(); suspend(2); break;
-        case (0x2B): AmIMM();   OpANC(); suspend(2); break;
-        case (0x2C): AmABS();   OpBIT(); suspend(4); break;
-        case (0x2D): AmABS();   OpAND(); suspend(4); break;
-        case (0x2E): AmABS();   OpROL(); suspend(6); break;
-        case (0x2F): AmABS();   OpRLA(); suspend(6); break;
-        case (0x30): AmIMM();   OpBMI(); suspend(2); break;
-        case (0x31): AmINY_C(); OpAND(); suspend(5); break;
-        case (0x32): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x33): AmINY();   OpRLA(); suspend(8); break;
-        case (0x34): AmZPX();   OpDOP(); suspend(4); break;
-        case (0x35): AmZPX();   OpAND(); suspend(4); break;
-        case (0x36): AmZPX();   OpROL(); suspend(6); break;
-        case (0x37): AmZPX();   OpRLA(); suspend(6); break;
-        case (0x38): AmIMP();   OpSEC(); suspend(2); break;
-        case (0x39): AmABY_C(); OpAND(); suspend(4); break;
-        case (0x3A): AmIMP();   OpNOP(); suspend(2); break;
-        case (0x3B): AmABY();   OpRLA(); suspend(7); break;
-        case (0x3C): AmABX_C(); OpTOP(); suspend(4); break;
-        case (0x3D): AmABX_C(); OpAND(); suspend(4); break;
-        case (0x3E): AmABX();   OpROL(); suspend(7); break;
-        case (0x3F): AmABX();   OpRLA(); suspend(7); break;
-        case (0x40): AmIMP();   OpRTI(); suspend(6); break;
-        case (0x41): AmINX();   OpEOR(); suspend(6); break;
-        case (0x42): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x43): AmINX();   OpSRE(); suspend(8); break;
-        case (0x44): AmZPG();   OpDOP(); suspend(3); break;
-        case (0x45): AmZPG();   OpEOR(); suspend(3); break;
-        case (0x46): AmZPG();   OpLSR(); suspend(5); break;
-        case (0x47): AmZPG();   OpSRE(); suspend(5); break;
-        case (0x48): AmIMP();   OpPHA(); suspend(3); break;
-        case (0x49): AmIMM();   OpEOR(); suspend(2); break;
-        case (0x4A): AmACC();   OpLSR(); suspend(2); break;
-        case (0x4B): AmIMM();   OpALR(); suspend(2); break;
-        case (0x4C): AmABS();   OpJMP(); suspend(3); break;
-        case (0x4D): AmABS();   OpEOR(); suspend(4); break;
-        case (0x4E): AmABS();   OpLSR(); suspend(6); break;
-        case (0x4F): AmABS();   OpSRE(); suspend(6); break;
-        case (0x50): AmIMM();   OpBVC(); suspend(2); break;
-        case (0x51): AmINY_C(); OpEOR(); suspend(5); break;
-        case (0x52): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x53): AmINY();   OpSRE(); suspend(8); break;
-        case (0x54): AmZPX();   OpDOP(); suspend(4); break;
-        case (0x55): AmZPX();   OpEOR(); suspend(4); break;
-        case (0x56): AmZPX();   OpLSR(); suspend(6); break;
-        case (0x57): AmZPX();   OpSRE(); suspend(6); break;
-        case (0x58): AmIMP();   OpCLI(); suspend(2); break;
-        case (0x59): AmABY_C(); OpEOR(); suspend(4); break;
-        case (0x5A): AmIMP();   OpNOP(); suspend(2); break;
-        case (0x5B): AmABY();   OpSRE(); suspend(7); break;
-        case (0x5C): AmABX_C(); OpTOP(); suspend(4); break;
-        case (0x5D): AmABX_C(); OpEOR(); suspend(4); break;
-        case (0x5E): AmABX();   OpLSR(); suspend(7); break;
-        case (0x5F): AmABX();   OpSRE(); suspend(7); break;
-        case (0x60): AmIMP();   OpRTS(); suspend(6); break;
-        case (0x61): AmINX();   OpADC(); suspend(6); break;
-        case (0x62): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x63): AmINX();   OpRRA(); suspend(8); break;
-        case (0x64): AmZPG();   OpDOP(); suspend(3); break;
-        case (0x65): AmZPG();   OpADC(); suspend(3); break;
-        case (0x66): AmZPG();   OpROR(); suspend(5); break;
-        case (0x67): AmZPG();   OpRRA(); suspend(5); break;
-        case (0x68): AmIMP();   OpPLA(); suspend(4); break;
-        case (0x69): AmIMM();   OpADC(); suspend(2); break;
-        case (0x6A): AmACC();   OpROR(); suspend(2); break;
-        case (0x6B): AmIMM();   OpARR(); suspend(2); break;
-        case (0x6C): AmIND();   OpJMP(); suspend(5); break;
-        case (0x6D): AmABS();   OpADC(); suspend(4); break;
-        case (0x6E): AmABS();   OpROR(); suspend(6); break;
-        case (0x6F): AmABS();   OpRRA(); suspend(6); break;
-        case (0x70): AmIMM();   OpBVS(); suspend(2); break;
-        case (0x71): AmINY_C(); OpADC(); suspend(5); break;
-        case (0x72): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x73): AmINY();   OpRRA(); suspend(8); break;
-        case (0x74): AmZPX();   OpDOP(); suspend(4); break;
-        case (0x75): AmZPX();   OpADC(); suspend(4); break;
-        case (0x76): AmZPX();   OpROR(); suspend(6); break;
-        case (0x77): AmZPX();   OpRRA(); suspend(6); break;
-        case (0x78): AmIMP();   OpSEI(); suspend(2); break;
-        case (0x79): AmABY_C(); OpADC(); suspend(4); break;
-        case (0x7A): AmIMP();   OpNOP(); suspend(2); break;
-        case (0x7B): AmABY();   OpRRA(); suspend(7); break;
-        case (0x7C): AmABX_C(); OpTOP(); suspend(4); break;
-        case (0x7D): AmABX_C(); OpADC(); suspend(4); break;
-        case (0x7E): AmABX();   OpROR(); suspend(7); break;
-        case (0x7F): AmABX();   OpRRA(); suspend(7); break;
-        case (0x80): AmIMM();   OpDOP(); suspend(2); break;
-        case (0x81): AmINX();   OpSTA(); suspend(6); break;
-        case (0x82): AmIMM();   OpDOP(); suspend(2); break;
-        case (0x83): AmINX();   OpSAX(); suspend(6); break;
-        case (0x84): AmZPG();   OpSTY(); suspend(3); break;
-        case (0x85): AmZPG();   OpSTA(); suspend(3); break;
-        case (0x86): AmZPG();   OpSTX(); suspend(3); break;
-        case (0x87): AmZPG();   OpSAX(); suspend(3); break;
-        case (0x88): AmIMP();   OpDEY(); suspend(2); break;
-        case (0x89): AmIMM();   OpDOP(); suspend(2); break;
-        case (0x8A): AmIMP();   OpTXA(); suspend(2); break;
-        case (0x8B): AmIMM();   OpXAA(); suspend(2); break;
-        case (0x8C): AmABS();   OpSTY(); suspend(4); break;
-        case (0x8D): AmABS();   OpSTA(); suspend(4); break;
-        case (0x8E): AmABS();   OpSTX(); suspend(4); break;
-        case (0x8F): AmABS();   OpSAX(); suspend(4); break;
-        case (0x90): AmIMM();   OpBCC(); suspend(2); break;
-        case (0x91): AmINY();   OpSTA(); suspend(6); break;
-        case (0x92): AmIMP();   OpJAM(); suspend(0); break;
-        case (0x93): AmINY();   OpAHX(); suspend(6); break;
-        case (0x94): AmZPX();   OpSTY(); suspend(4); break;
-        case (0x95): AmZPX();   OpSTA(); suspend(4); break;
-        case (0x96): AmZPY();   OpSTX(); suspend(4); break;
-        case (0x97): AmZPY();   OpSAX(); suspend(4); break;
-        case (0x98): AmIMP();   OpTYA(); suspend(2); break;
-        case (0x99): AmABY();   OpSTA(); suspend(5); break;
-        case (0x9A): AmIMP();   OpTXS(); suspend(2); break;
-        case (0x9B): AmABY();   OpXAS(); suspend(5); break;
-        case (0x9C): AmABX();   OpSHY(); suspend(5); break;
-        case (0x9D): AmABX();   OpSTA(); suspend(5); break;
-        case (0x9E): AmABY();   OpSHX(); suspend(5); break;
-        case (0x9F): AmABY();   OpAHX(); suspend(5); break;
-        case (0xA0): AmIMM();   OpLDY(); suspend(2); break;
-        case (0xA1): AmINX();   OpLDA(); suspend(6); break;
-        case (0xA2): AmIMM();   OpLDX(); suspend(2); break;
-        case (0xA3): AmINX();   OpLAX(); suspend(6); break;
-        case (0xA4): AmZPG();   OpLDY(); suspend(3); break;
-        case (0xA5): AmZPG();   OpLDA(); suspend(3); break;
-        case (0xA6): AmZPG();   OpLDX(); suspend(3); break;
-        case (0xA7): AmZPG();   OpLAX(); suspend(3); break;
-        case (0xA8): AmIMP();   OpTAY(); suspend(2); break;
-        case (0xA9): AmIMM();   OpLDA(); suspend(2); break;
-        case (0xAA): AmIMP();   OpTAX(); suspend(2); break;
-        case (0xAB): AmIMM();   OpLAX(); suspend(2); break;
-        case (0xAC): AmABS();   OpLDY(); suspend(4); break;
-        case (0xAD): AmABS();   OpLDA(); suspend(4); break;
-        case (0xAE): AmABS();   OpLDX(); suspend(4); break;
-        case (0xAF): AmABS();   OpLAX(); suspend(4); break;
-        case (0xB0): AmIMM();   OpBCS(); suspend(2); break;
-        case (0xB1): AmINY_C(); OpLDA(); suspend(5); break;
-        case (0xB2): AmIMP();   OpJAM(); suspend(0); break;
-        case (0xB3): AmINY();   OpLAX(); suspend(5); break;
-        case (0xB4): AmZPX();   OpLDY(); suspend(4); break;
-        case (0xB5): AmZPX();   OpLDA(); suspend(4); break;
-        case (0xB6): AmZPY();   OpLDX(); suspend(4); break;
-        case (0xB7): AmZPY();   OpLAX(); suspend(4); break;
-        case (0xB8): AmIMP();   OpCLV(); suspend(2); break;
-        case (0xB9): AmABY_C(); OpLDA(); suspend(4); break;
-        case (0xBA): AmIMP();   OpTSX(); suspend(2); break;
-        case (0xBB): AmABY();   OpLAR(); suspend(4); break;
-        case (0xBC): AmABX_C(); OpLDY(); suspend(4); break;
-        case (0xBD): AmABX_C(); OpLDA(); suspend(4); break;
-        case (0xBE): AmABY_C(); OpLDX(); suspend(4); break;
-        case (0xBF): AmABY();   OpLAX(); suspend(4); break;
-        case (0xC0): AmIMM();   OpCPY(); suspend(2); break;
-        case (0xC1): AmINX();   OpCMP(); suspend(6); break;
-        case (0xC2): AmIMM();   OpDOP(); suspend(2); break;
-        case (0xC3): AmINX();   OpDCP(); suspend(8); break;
-        case (0xC4): AmZPG();   OpCPY(); suspend(3); break;
-        case (0xC5): AmZPG();   OpCMP(); suspend(3); break;
-        case (0xC6): AmZPG();   OpDEC(); suspend(5); break;
-        case (0xC7): AmZPG();   OpDCP(); suspend(5); break;
-        case (0xC8): AmIMP();   OpINY(); suspend(2); break;
-        case (0xC9): AmIMM();   OpCMP(); suspend(2); break;
-        case (0xCA): AmIMP();   OpDEX(); suspend(2); break;
-        case (0xCB): AmIMM();   OpAXS(); suspend(2); break;
-        case (0xCC): AmABS();   OpCPY(); suspend(4); break;
-        case (0xCD): AmABS();   OpCMP(); suspend(4); break;
-        case (0xCE): AmABS();   OpDEC(); suspend(6); break;
-        case (0xCF): AmABS();   OpDCP(); suspend(6); break;
-        case (0xD0): AmIMM();   OpBNE(); suspend(2); break;
-        case (0xD1): AmINY_C(); OpCMP(); suspend(5); break;
-        case (0xD2): AmIMP();   OpJAM(); suspend(0); break;
-        case (0xD3): AmINY();   OpDCP(); suspend(8); break;
-        case (0xD4): AmZPX();   OpDOP(); suspend(4); break;
-        case (0xD5): AmZPX();   OpCMP(); suspend(4); break;
-        case (0xD6): AmZPX();   OpDEC(); suspend(6); break;
-        case (0xD7): AmZPX();   OpDCP(); suspend(6); break;
-        case (0xD8): AmIMP();   OpCLD(); suspend(2); break;
-        case (0xD9): AmABY_C(); OpCMP(); suspend(4); break;
-        case (0xDA): AmIMP();   OpNOP(); suspend(2); break;
-        case (0xDB): AmABY();   OpDCP(); suspend(7); break;
-        case (0xDC): AmABX_C(); OpTOP(); suspend(4); break;
-        case (0xDD): AmABX_C(); OpCMP(); suspend(4); break;
-        case (0xDE): AmABX();   OpDEC(); suspend(7); break;
-        case (0xDF): AmABX();   OpDCP(); suspend(7); break;
-        case (0xE0): AmIMM();   OpCPX(); suspend(2); break;
-        case (0xE1): AmINX();   OpSBC(); suspend(6); break;
-        case (0xE2): AmIMM();   OpDOP(); suspend(2); break;
-        case (0xE3): AmINX();   OpISC(); suspend(8); break;
-        case (0xE4): AmZPG();   OpCPX(); suspend(3); break;
-        case (0xE5): AmZPG();   OpSBC(); suspend(3); break;
-        case (0xE6): AmZPG();   OpINC(); suspend(5); break;
-        case (0xE7): AmZPG();   OpISC(); suspend(5); break;
-        case (0xE8): AmIMP();   OpINX(); suspend(2); break;
-        case (0xE9): AmIMM();   OpSBC(); suspend(2); break;
-        case (0xEA): AmIMP();   OpNOP(); suspend(2); break;
-        case (0xEB): AmIMM();   OpSBC(); suspend(2); break;
-        case (0xEC): AmABS();   OpCPX(); suspend(4); break;
-        case (0xED): AmABS();   OpSBC(); suspend(4); break;
-        case (0xEE): AmABS();   OpINC(); suspend(6); break;
-        case (0xEF): AmABS();   OpISC(); suspend(6); break;
-        case (0xF0): AmIMM();   OpBEQ(); suspend(2); break;
-        case (0xF1): AmINY_C(); OpSBC(); suspend(5); break;
-        case (0xF2): AmIMP();   OpJAM(); suspend(0); break;
-        case (0xF3): AmINY();   OpISC(); suspend(8); break;
-        case (0xF4): AmZPX();   OpDOP(); suspend(4); break;
-        case (0xF5): AmZPX();   OpSBC(); suspend(4); break;
-        case (0xF6): AmZPX();   OpINC(); suspend(6); break;
-        case (0xF7): AmZPX();   OpISC(); suspend(6); break;
-        case (0xF8): AmIMP();   OpSED(); suspend(2); break;
-        case (0xF9): AmABY_C(); OpSBC(); suspend(4); break;
-        case (0xFA): AmIMP();   OpNOP(); suspend(2); break;
-        case (0xFB): AmABY();   OpISC(); suspend(7); break;
-        case (0xFC): AmABX_C(); OpTOP(); suspend(4); break;
-        case (0xFD): AmABX_C(); OpSBC(); suspend(4); break;
-        case (0xFE): AmABX();   OpINC(); suspend(7); break;
-        case (0xFF): AmABX();   OpISC(); suspend(7); break;
+        OPCODES_256(OPCODE_CASE)
+    }
+#undef OPCODE_OPERAND
+    return 0;
+#endif
+}
+
+#ifdef CPU_BLOCK_CACHE
+
+template <class Bus>
+int CPU<Bus>::runDecodedInstr(Registers &r, const DecodedOp &op)
+{
+#ifdef CPU_SWITCH_DISPATCH
+    return executeUnfused(r, op.opCode, op.operand);
+#else
+#define OPCODE_OPERAND(n) op.operand
+    switch(op.opCode) {
+        OPCODES_256(OPCODE_CASE)
     }
+#undef OPCODE_OPERAND
+    return 0;
+#endif
 }
+
+#endif
+
+#undef OPCODE_CASE
+#undef OPCODES_256
+#undef OPCODES_16
+
+template class CPU<Console>;
+template class CPU<FunctionBus>;
@@ -3,162 +3,343 @@
 
 #include <cstdint>
 #include <functional>
+#include <ostream>
+
+#include <BlockCache.h>
+#include <Opcodes.h>
+#include <Profile.h>
+#include <Trace.h>
+
+#ifdef CPU_TRACE
+#ifdef CPU_BLOCK_CACHE
+#error "CPU_TRACE only traces interpreted instructions"
+#endif
+// every instruction has to be run to be traced
+#ifndef CPU_STEP_IDLE_LOOPS
+#define CPU_STEP_IDLE_LOOPS
+#endif
+typedef TraceBuffer CpuTrace;
+#else
+typedef NoTrace CpuTrace;
+#endif
+
+#ifdef CPU_PROFILE
+#ifdef CPU_BLOCK_CACHE
+#error "CPU_PROFILE only profiles interpreted instructions"
+#endif
+// idle loops are profiled as the time they take
+#ifndef CPU_STEP_IDLE_LOOPS
+#define CPU_STEP_IDLE_LOOPS
+#endif
+typedef Profiler CpuProfile;
+#else
+typedef NoProfile CpuProfile;
+#endif
 
 static const uint16_t NMI_VECTOR = 0xFFFA;
 static const uint16_t RESET_VECTOR = 0xFFFC;
 static const uint16_t IRQ_VECTOR = 0xFFFE;
 
+// forces the per-opcode handlers to be flattened into the dispatch switch,
+// so that their address mode and operation are folded at compile time
+#if defined(__GNUC__)
+#define CPU_INLINE inline __attribute__((always_inline))
+#else
+#define CPU_INLINE inline
+#endif
+
 using BusRead = std::function<uint8_t(uint16_t)>;
 using BusWrite = std::function<void(uint16_t, uint8_t)>;
 
+// binds the cpu to its memory through std::function callbacks, which
+// can't be inlined; kept as a baseline for benchmarking
+class FunctionBus
+{
+public:
+    FunctionBus(BusRead read, BusWrite write) : read(read), write(write) { }
+    uint8_t cpuRead(uint16_t addr) { return read(addr); }
+    void cpuWrite(uint16_t addr, uint8_t value) { write(addr, value); }
+    // no direct access to memory, so nothing can be block cached
+    const uint8_t *getReadPage(uint16_t addr) { return NULL; }
+    uint8_t *getWritePage(uint16_t addr) { return NULL; }
+    uint32_t getMapGeneration() { return 0; }
+    // reads may have any side effect, so idle loops are always stepped
+    bool isStableRead(uint16_t addr) { return false; }
+    int getPrgBank(uint16_t addr) { return -1; }
+
+private:
+    BusRead read;
+    BusWrite write;
+};
+
+// Bus must provide cpuRead() and cpuWrite(), which are bound statically
+// so that they can be inlined into the instruction handlers. The block
+// cache (CPU_BLOCK_CACHE) also uses its getReadPage(), getWritePage() and
+// getMapGeneration() to find and invalidate decoded code.
+//
+// isStableRead() tells whether reading addr has no side effects beyond
+// those of the last read, and returns a value that can only change at the
+// end of the current run() budget. Loops that only make such reads are
+// skipped over rather than stepped (see skipIdleLoop()).
+//
+// getPrgBank() gives the prg rom bank mapped at addr, or -1, for
+// CPU_PROFILE.
+template <class Bus>
 class CPU
 {
 public:
-    CPU(BusRead read, BusWrite write) : read(read), write(write) { }
+    CPU(Bus &bus);
     void reset();
-    void tick();
+    // execute whole instructions until at least cycleBudget cycles have
+    // elapsed, returning the number of cycles that actually elapsed
+    int64_t run(int64_t cycleBudget);
     void signalNMI();
     void signalIRQ();
     void suspend(int cycles);
+    // cycles since reset, up to the start of the current instruction
+    uint64_t getCycles() { return cycles; }
+    // the cycle a store or read-modify-write makes its write on, the
+    // last of its instruction; only meaningful from inside the write
+    uint64_t getWriteCycle() { return cycles + instrCycles - 1; }
+    uint64_t getInstructionCount() { return instructionCount; }
+    // write the last instructions run in nestest.log's format, returning
+    // false if tracing isn't built in (needs CPU_TRACE)
+    bool writeTrace(std::ostream &out) { return trace.write(out); }
+    // write the cycles counted per pc, bank and opcode, and per call stack
+    // in collapsed form, returning false if profiling isn't built in
+    // (needs CPU_PROFILE)
+    bool writeProfile(std::ostream &summary, std::ostream &stacks) {
+        return profile.writeSummary(summary) && profile.writeStacks(stacks);
+    }
 
 private:
-    // memory access callbacks
-    BusRead read;
-    BusWrite write;
+    Bus &bus;
+    // cycles taken by the instruction being run, once it's addressed
+    int instrCycles;
+    uint8_t read(uint16_t addr) {
+#ifndef CPU_STEP_IDLE_LOOPS
+        if(idleProbe && !bus.isStableRead(addr)) {
+            idleClean = false;
+        }
+#endif
+        return bus.cpuRead(addr);
+    }
+    void write(uint16_t addr, uint8_t value) {
+#ifndef CPU_STEP_IDLE_LOOPS
+        idleClean = false;
+#endif
+        bus.cpuWrite(addr, value);
+#ifdef CPU_BLOCK_CACHE
+        if(blockCache.isCodePage(addr)) {
+            invalidateCode(addr);
+        }
+        if(bus.getMapGeneration() != mapGeneration) {
+            codeInvalidated = 1; // e.g. a bank switch
+        }
+#endif
+    }
+
+    struct Registers
+    {
+        uint16_t pc;
+        uint8_t sp;
+        uint8_t acc;
+        uint8_t x;
+        uint8_t y;
+        // status flags
+        int carry;
+        int intdisable;
+        int decmode;
+        int brk;
+        int overflow;
+#ifdef CPU_LAZY_FLAGS
+        // the result bytes that last set z and n, which are only worked
+        // out when read by a branch or getStatus()
+        uint8_t zeroResult;
+        uint8_t negativeResult;
+#else
+        int zero;
+        int negative;
+#endif
+    };
 
-    // registers
-    uint16_t pc;
-    uint8_t sp;
-    uint8_t acc;
-    uint8_t x;
-    uint8_t y;
-    // status flags
-    int carry;
-    int zero;
-    int intdisable;
-    int decmode;
-    int brk;
-    int overflow;
-    int negative;
-    // address mode parameters
-    uint16_t targetAddr;
-    uint16_t operand16;
-    uint8_t operand8;
-    int useAcc;
+    // only up to date outside of run(), which works on a local copy
+    Registers regs;
     // interrupt signals
     int nmiSignal;
     int irqSignal;
+    // set by a JAM opcode, which halts the cpu until reset
+    int jammed;
+
+#ifndef CPU_STEP_IDLE_LOOPS
+    // set while skipIdleLoop() runs a loop's body, which any write or
+    // unstable read makes unsafe to skip by clearing idleClean
+    bool idleProbe;
+    bool idleClean;
+    // the last loop found not to be idle, so that busy loops aren't
+    // probed on every iteration; forgotten on the next NMI
+    uint16_t idleRejectedHead;
+    uint16_t idleRejectedTail;
+    // after a backward jump from tail to r.pc, run one more iteration and
+    // if it left the registers unchanged skip every iteration that fits
+    // in the budget, returning the instructions run or skipped
+    uint64_t skipIdleLoop(Registers &r, uint16_t tail, uint64_t endCycle);
+    bool sameRegisters(const Registers &a, const Registers &b);
+#endif
+
+#ifdef CPU_BLOCK_CACHE
+    BlockCache blockCache;
+    // set when a write may have changed the running block or remapped it
+    int codeInvalidated;
+    // the bus mapping the cached blocks were checked against
+    uint32_t mapGeneration;
+    Block *getBlock(uint16_t pc);
+    void decodeBlock(Block &block, uint16_t pc, const uint8_t *page);
+    int runBlock(Registers &r, const Block &block, uint64_t endCycle);
+    void invalidateCode(uint16_t addr);
+    CPU_INLINE int runDecodedInstr(Registers &r, const DecodedOp &op);
+#endif
+
+    CpuTrace trace;
+    void traceInstr(Registers &r);
+    CpuProfile profile;
+    // executeNextOp(), counting the instruction's cycles
+    int profileInstr(Registers &r);
 
-    void executeNextOp();
-    void push8(uint8_t value);
-    void push16(uint16_t value);
-    uint8_t pop8();
-    uint16_t pop16();
+    int executeNextOp(Registers &r);
+    void push8(Registers &r, uint8_t value);
+    void push16(Registers &r, uint16_t value);
+    uint8_t pop8(Registers &r);
+    uint16_t pop16(Registers &r);
     uint16_t loadAddr(uint16_t addr);
-    uint8_t getStatus();
-    void setStatus(uint8_t value);
-    void handleInterrupts();
-    void branch();
+    uint8_t getStatus(Registers &r);
+    void setStatus(Registers &r, uint8_t value);
+    // z and n are set from a result byte, going through these so that
+    // CPU_LAZY_FLAGS can defer the comparisons
+    void setZN(Registers &r, uint8_t result);
+    void setZero(Registers &r, uint8_t result);
+    void setNegative(Registers &r, uint8_t result);
+    int getZero(Registers &r);
+    int getNegative(Registers &r);
+    int handleInterrupts(Registers &r);
+    int branch(Registers &r, uint16_t addr);
 
-    int cyclesLeft;
+    uint64_t cycles;
+    // cycles stolen from the cpu by suspend(), e.g. for DMA
+    int stallCycles;
+    uint64_t instructionCount;
 
     // instructions
-    void OpADC();
-    void OpAND();
-    void OpASL();
-    void OpBRK();
-    void OpBCC();
-    void OpBCS();
-    void OpBEQ();
-    void OpBIT();
-    void OpBMI();
-    void OpBNE();
-    void OpBPL();
-    void OpBVC();
-    void OpBVS();
-    void OpCLC();
-    void OpCLD();
-    void OpCLI();
-    void OpCLV();
-    void OpCMP();
-    void OpCPX();
-    void OpCPY();
-    void OpDEC();
-    void OpDEX();
-    void OpDEY();
-    void OpEOR();
-    void OpINC();
-    void OpINX();
-    void OpINY();
-    void OpJMP();
-    void OpJSR();
-    void OpLDA();
-    void OpLDX();
-    void OpLDY();
-    void OpLSR();
-    void OpNOP();
-    void OpORA();
-    void OpPHA();
-    void OpPHP();
-    void OpPLA();
-    void OpPLP();
-    void OpROL();
-    void OpROR();
-    void OpRTI();
-    void OpRTS();
-    void OpSBC();
-    void OpSEC();
-    void OpSED();
-    void OpSEI();
-    void OpSTA();
-    void OpSTX();
-    void OpSTY();
-    void OpTAX();
-    void OpTAY();
-    void OpTSX();
-    void OpTXA();
-    void OpTXS();
-    void OpTYA();
+    void OpADC(Registers &r, uint16_t addr);
+    void OpAND(Registers &r, uint16_t addr);
+    void OpASL(Registers &r, uint16_t addr, bool useAcc);
+    void OpBRK(Registers &r, uint16_t addr);
+    int OpBCC(Registers &r, uint16_t addr);
+    int OpBCS(Registers &r, uint16_t addr);
+    int OpBEQ(Registers &r, uint16_t addr);
+    void OpBIT(Registers &r, uint16_t addr);
+    int OpBMI(Registers &r, uint16_t addr);
+    int OpBNE(Registers &r, uint16_t addr);
+    int OpBPL(Registers &r, uint16_t addr);
+    int OpBVC(Registers &r, uint16_t addr);
+    int OpBVS(Registers &r, uint16_t addr);
+    void OpCLC(Registers &r, uint16_t addr);
+    void OpCLD(Registers &r, uint16_t addr);
+    void OpCLI(Registers &r, uint16_t addr);
+    void OpCLV(Registers &r, uint16_t addr);
+    void OpCMP(Registers &r, uint16_t addr);
+    void OpCPX(Registers &r, uint16_t addr);
+    void OpCPY(Registers &r, uint16_t addr);
+    void OpDEC(Registers &r, uint16_t addr);
+    void OpDEX(Registers &r, uint16_t addr);
+    void OpDEY(Registers &r, uint16_t addr);
+    void OpEOR(Registers &r, uint16_t addr);
+    void OpINC(Registers &r, uint16_t addr);
+    void OpINX(Registers &r, uint16_t addr);
+    void OpINY(Registers &r, uint16_t addr);
+    void OpJMP(Registers &r, uint16_t addr);
+    void OpJSR(Registers &r, uint16_t addr);
+    void OpLDA(Registers &r, uint16_t addr);
+    void OpLDX(Registers &r, uint16_t addr);
+    void OpLDY(Registers &r, uint16_t addr);
+    void OpLSR(Registers &r, uint16_t addr, bool useAcc);
+    void OpNOP(Registers &r, uint16_t addr);
+    void OpORA(Registers &r, uint16_t addr);
+    void OpPHA(Registers &r, uint16_t addr);
+    void OpPHP(Registers &r, uint16_t addr);
+    void OpPLA(Registers &r, uint16_t addr);
+    void OpPLP(Registers &r, uint16_t addr);
+    void OpROL(Registers &r, uint16_t addr, bool useAcc);
+    void OpROR(Registers &r, uint16_t addr, bool useAcc);
+    void OpRTI(Registers &r, uint16_t addr);
+    void OpRTS(Registers &r, uint16_t addr);
+    void OpSBC(Registers &r, uint16_t addr);
+    void OpSEC(Registers &r, uint16_t addr);
+    void OpSED(Registers &r, uint16_t addr);
+    void OpSEI(Registers &r, uint16_t addr);
+    void OpSTA(Registers &r, uint16_t addr);
+    void OpSTX(Registers &r, uint16_t addr);
+    void OpSTY(Registers &r, uint16_t addr);
+    void OpTAX(Registers &r, uint16_t addr);
+    void OpTAY(Registers &r, uint16_t addr);
+    void OpTSX(Registers &r, uint16_t addr);
+    void OpTXA(Registers &r, uint16_t addr);
+    void OpTXS(Registers &r, uint16_t addr);
+    void OpTYA(Registers &r, uint16_t addr);
     // undocumented ops
-    void OpJAM();
-    void OpSLO();
-    void OpDOP();
-    void OpANC();
-    void OpTOP();
-    void OpRLA();
-    void OpSRE();
-    void OpALR();
-    void OpRRA();
-    void OpARR();
-    void OpSAX();
-    void OpXAA();
-    void OpAHX();
-    void OpXAS();
-    void OpSHY();
-    void OpSHX();
-    void OpLAX();
-    void OpLAR();
-    void OpDCP();
-    void OpAXS();
-    void OpISC();
+    void OpJAM(Registers &r, uint16_t addr);
+    void OpSLO(Registers &r, uint16_t addr);
+    void OpDOP(Registers &r, uint16_t addr);
+    void OpANC(Registers &r, uint16_t addr);
+    void OpTOP(Registers &r, uint16_t addr);
+    void OpRLA(Registers &r, uint16_t addr);
+    void OpSRE(Registers &r, uint16_t addr);
+    void OpALR(Registers &r, uint16_t addr);
+    void OpRRA(Registers &r, uint16_t addr);
+    void OpARR(Registers &r, uint16_t addr);
+    void OpSAX(Registers &r, uint16_t addr);
+    void OpXAA(Registers &r, uint16_t addr);
+    void OpAHX(Registers &r, uint16_t addr);
+    void OpXAS(Registers &r, uint16_t addr);
+    void OpSHY(Registers &r, uint16_t addr);
+    void OpSHX(Registers &r, uint16_t addr);
+    void OpLAX(Registers &r, uint16_t addr);
+    void OpLAR(Registers &r, uint16_t addr);
+    void OpDCP(Registers &r, uint16_t addr);
+    void OpAXS(Registers &r, uint16_t addr);
+    void OpISC(Registers &r, uint16_t addr);
     // address modes
-    void AmABS();
-    void AmABX();
-    void AmABX_C();
-    void AmABY();
-    void AmABY_C();
-    void AmACC();
-    void AmIMM();
-    void AmIMP();
-    void AmIND();
-    void AmINX();
-    void AmINY();
-    void AmINY_C();
-    void AmZPG();
-    void AmZPX();
-    void AmZPY();
-
-    void runInstr(uint8_t opCode);
+    uint16_t AmABS(Registers &r, uint16_t operand);
+    uint16_t AmABX(Registers &r, uint16_t operand);
+    uint16_t AmABX_C(Registers &r, uint16_t operand, int &cycles);
+    uint16_t AmABY(Registers &r, uint16_t operand);
+    uint16_t AmABY_C(Registers &r, uint16_t operand, int &cycles);
+    uint16_t AmACC(Registers &r);
+    uint16_t AmIMM(Registers &r);
+    uint16_t AmIMP(Registers &r);
+    uint16_t AmIND(Registers &r, uint16_t operand);
+    uint16_t AmINX(Registers &r, uint16_t operand);
+    uint16_t AmINY(Registers &r, uint16_t operand);
+    uint16_t AmINY_C(Registers &r, uint16_t operand, int &cycles);
+    uint16_t AmREL(Registers &r, uint16_t operand);
+    uint16_t AmZPG(Registers &r, uint16_t operand);
+    uint16_t AmZPX(Registers &r, uint16_t operand);
+    uint16_t AmZPY(Registers &r, uint16_t operand);
+
+    // read the bytes following the opcode that the address mode needs
+    CPU_INLINE uint16_t fetchOperand(Registers &r, AddrMode mode);
+    // resolve the operand address, adding any page crossing penalty
+    CPU_INLINE uint16_t address(Registers &r, AddrMode mode, bool pageCrossPenalty, uint16_t operand, int &cycles);
+    // perform the operation, returning any extra cycles taken
+    CPU_INLINE int operate(Registers &r, Operation operation, AddrMode mode, uint16_t addr);
+    // one handler per opcode, specialised on its OPCODES entry
+    template <uint8_t OPCODE>
+    CPU_INLINE int execute(Registers &r, uint16_t operand);
+    // the same, looking the opcode up at run time
+    CPU_INLINE int executeUnfused(Registers &r, uint8_t opCode, uint16_t operand);
+
+    // returns the cycles taken by the instruction
+    int runInstr(Registers &r, uint8_t opCode);
 };
 
 #endif
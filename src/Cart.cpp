@@ -1,6 +1,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <fstream>
+#include <istream>
 #include <string>
 #include <memory>
 #include <vector>
@@ -9,6 +10,9 @@
 #include <Cart.h>
 #include <CartMemory.h>
 #include <Mirroring.h>
+#include <MemoryMap.h>
+#include <ChrMap.h>
+#include <NameTableMap.h>
 #include <Mapper.h>
 #include <mappers/Mapper0.h>
 #include <mappers/Mapper1.h>
@@ -16,7 +20,11 @@
 void Cart::loadFile(std::string romFileName)
 {
     std::ifstream romFileStream(romFileName.c_str(), std::ios::binary);
+    loadStream(romFileStream);
+}
 
+void Cart::loadStream(std::istream& romFileStream)
+{
     std::vector<char> iNesHeader = getINesHeaderFromFile(romFileStream);
     bool isValidHeader = verifyINesHeaderSignature(iNesHeader);
     if(!isValidHeader) {
@@ -25,15 +33,13 @@ void Cart::loadFile(std::string romFileName)
 
     CartMemory mem = getCartMemoryFromFile(iNesHeader, romFileStream);
 
-    romFileStream.close();
-
     int mapperNum = getMapperNumberFromHeader(iNesHeader);
     if (!initializeMapper(mapperNum, mem)) {
 	throw std::runtime_error(std::string("Mapper %d not yet supported", mapperNum));
     }
 }
 
-std::vector<char> Cart::getINesHeaderFromFile(std::ifstream& romFileStream)
+std::vector<char> Cart::getINesHeaderFromFile(std::istream& romFileStream)
 {
     std::vector<char> header;
     for(int i  = 0; i < 16; ++i) {
@@ -51,7 +57,7 @@ bool Cart::verifyINesHeaderSignature(std::vector<char> iNesHeader)
 	    iNesHeader[3] == 0x1A);
 }
 
-CartMemory Cart::getCartMemoryFromFile(std::vector<char> iNesHeader, std::ifstream& romFileStream)
+CartMemory Cart::getCartMemoryFromFile(std::vector<char> iNesHeader, std::istream& romFileStream)
 {
     CartMemory mem;
 
@@ -93,7 +99,7 @@ CartMemory Cart::getCartMemoryFromFile(std::vector<char> iNesHeader, std::ifstre
     }
     if (iNesHeader[6] & (0x1 << 3)) {
         mem.mirroring = MIRROR_FOUR_SCREEN;
-        throw std::runtime_error("Four screen mirroring not yet supported");
+        mem.nameTableRam.resize(2 * NAME_TABLE_SIZE);
     }
 
     return mem;
@@ -108,19 +114,20 @@ bool Cart::initializeMapper(int mapperNum, CartMemory mem)
 {
     switch(mapperNum) {
     case 0:
-	mapper = std::unique_ptr<Mapper>(new Mapper0(mem));
+	mapper = std::unique_ptr<Mapper>(new Mapper0(mem, memoryMap, chrMap, nameTableMap));
 	return true;
     case 1:
-    	mapper = std::unique_ptr<Mapper>(new Mapper1(mem));
+    	mapper = std::unique_ptr<Mapper>(new Mapper1(mem, memoryMap, chrMap, nameTableMap));
     	return true;
     default:
         return false;
     }
 }
 
-Mirroring Cart::getMirroring()
+int Cart::getPrgBank(const uint8_t *mem)
 {
-    return mapper->getMirroring();
+    long offset = mapper ? mapper->getPrgOffset(mem) : -1;
+    return (offset < 0) ? -1 : offset / PRG_BANK_SIZE;
 }
 
 uint8_t Cart::readPrg(uint16_t addr)
@@ -142,3 +149,8 @@ void Cart::writeChr(uint16_t addr, uint8_t value)
 {
     mapper->writeChr(addr, value);
 }
+
+void Cart::clockA12()
+{
+    mapper->clockA12();
+}
@@ -3,12 +3,16 @@
 
 #include <cstdint>
 #include <fstream>
+#include <istream>
 #include <string>
 #include <memory>
 
 #include <CartMemory.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
 #include <Mapper.h>
 #include <Mirroring.h>
+#include <NameTableMap.h>
 
 static const int PRG_BANK_SIZE = 16 * 1024;
 static const int CHR_BANK_SIZE = 8 * 1024;
@@ -18,20 +22,30 @@ static const int TRAINER_SIZE = 512;
 class Cart
 {
 public:
+    Cart(MemoryMap *memoryMap, ChrMap *chrMap,
+         NameTableMap *nameTableMap) : memoryMap(memoryMap),
+                                       chrMap(chrMap),
+                                       nameTableMap(nameTableMap) { }
     void loadFile(std::string romFileName);
+    void loadStream(std::istream& romFileStream);
     uint8_t readPrg(uint16_t addr);
     void writePrg(uint16_t addr, uint8_t value);
     uint8_t readChr(uint16_t addr);
     void writeChr(uint16_t addr, uint8_t value);
-    Mirroring getMirroring();
+    void clockA12();
+    // the 16KB prg bank holding host memory mem, or -1 if it isn't prg rom
+    int getPrgBank(const uint8_t *mem);
 
 private:
-    std::vector<char> getINesHeaderFromFile(std::ifstream& romFileStream);
+    std::vector<char> getINesHeaderFromFile(std::istream& romFileStream);
     bool verifyINesHeaderSignature(std::vector<char> iNesHeader);
-    CartMemory getCartMemoryFromFile(std::vector<char> iNesHeader, std::ifstream& romFileStream);
+    CartMemory getCartMemoryFromFile(std::vector<char> iNesHeader, std::istream& romFileStream);
     int getMapperNumberFromHeader(std::vector<char> iNesHeader);
     bool initializeMapper(int mapperNum, CartMemory mem);
 
+    MemoryMap *memoryMap;
+    ChrMap *chrMap;
+    NameTableMap *nameTableMap;
     std::unique_ptr<Mapper> mapper;
 };
 
@@ -14,6 +14,8 @@ struct CartMemory
     std::vector<uint8_t> prg;
     std::vector<uint8_t> chr;
     std::vector<uint8_t> ram;
+    // the last two name tables, on four screen carts
+    std::vector<uint8_t> nameTableRam;
 };
 
 #endif
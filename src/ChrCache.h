@@ -0,0 +1,65 @@
+#ifndef CHR_CACHE_H
+#define CHR_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Notes:
+ *
+ * - Pattern data is stored as two bit planes, so pulling out a pixel
+ * takes a shift and mask from each. The cache holds every tile row of
+ * the cart's chr memory decoded to one byte (0-3) per pixel, along with
+ * a horizontally flipped copy, so renderers can copy whole 8 pixel rows.
+ *
+ * - Rows are keyed by their offset into chr memory rather than by ppu
+ * address, so a bank switch needs nothing from the cache. Tiles are
+ * decoded the first time they're used, and a write to chr ram marks
+ * the tile written to be decoded again.
+ */
+
+class ChrCache
+{
+public:
+    ChrCache() : chr(NULL) { }
+    // starts over for the given chr memory
+    void reset(const uint8_t *chr, long chrSize) {
+	this->chr = chr;
+	rows.assign(chrSize * 8, 0);
+	decoded.assign(chrSize / 16, false);
+    }
+    // 8 pixels of the tile row whose first plane is at offset in chr memory
+    const uint8_t *getRow(long offset, bool flip) {
+	long tile = offset >> 4;
+	if (!decoded[tile]) {
+	    decodeTile(tile);
+	}
+	return &rows[(tile << 7) | ((offset & 0x7) << 4) | (flip ? 8 : 0)];
+    }
+    void invalidate(long offset) {
+	decoded[offset >> 4] = false;
+    }
+
+private:
+    void decodeTile(long tile) {
+	const uint8_t *pattern = chr + (tile << 4);
+	uint8_t *row = &rows[tile << 7];
+	for (int y = 0; y < 8; ++y, row += 16) {
+	    for (int x = 0; x < 8; ++x) {
+		uint8_t value = ((pattern[y] >> (7 - x)) & 0x1) |
+		    (((pattern[y + 8] >> (7 - x)) & 0x1) << 1);
+		row[x] = value;
+		row[15 - x] = value;
+	    }
+	}
+	decoded[tile] = true;
+    }
+
+    const uint8_t *chr;
+    // 16 bytes per tile row, unflipped then flipped
+    std::vector<uint8_t> rows;
+    std::vector<bool> decoded;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef CHR_MAP_H
+#define CHR_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Notes:
+ *
+ * - The ppu's pattern tables ($0000-$1FFF) are split into 1KB pages. Each
+ * page points at the chr rom or ram backing it, along with its offset
+ * into the cart's chr memory, so the ppu can fetch pattern bytes without
+ * going through the mapper.
+ *
+ * - As with the cpu's MemoryMap, mappers remap their pages whenever they
+ * switch chr banks, which changes the generation. Anything the ppu has
+ * decoded from pattern data can check it to tell when it may be stale.
+ *
+ * - Writes to chr ram still go through the mapper.
+ */
+
+static const int CHR_PAGE_SIZE = 0x400;
+static const int CHR_PAGE_COUNT = 8;
+
+class ChrMap
+{
+public:
+    ChrMap() : chr(empty), chrSize(CHR_PAGE_SIZE), generation(0) {
+	for (int i = 0; i < CHR_PAGE_COUNT; ++i) {
+	    pages[i] = empty;
+	    offsets[i] = 0;
+	}
+	for (int i = 0; i < CHR_PAGE_SIZE; ++i) {
+	    empty[i] = 0;
+	}
+    }
+    uint8_t read(uint16_t addr) {
+	return pages[(addr >> 10) & (CHR_PAGE_COUNT - 1)][addr & (CHR_PAGE_SIZE - 1)];
+    }
+    // offset into the cart's chr memory of addr
+    long getOffset(uint16_t addr) {
+	return offsets[(addr >> 10) & (CHR_PAGE_COUNT - 1)] + (addr & (CHR_PAGE_SIZE - 1));
+    }
+    // the chr memory that pages are mapped from
+    const uint8_t *getChr() {
+	return chr;
+    }
+    long getChrSize() {
+	return chrSize;
+    }
+    // changes whenever any page is mapped somewhere else
+    uint32_t getGeneration() {
+	return generation;
+    }
+    // maps size bytes of chr memory from offset, which wraps around
+    // chrSize, to addr
+    void map(int addr, int size, const uint8_t *chr, long chrSize, long offset) {
+	this->chr = chr;
+	this->chrSize = chrSize;
+	for (int page = 0; page < size; page += CHR_PAGE_SIZE) {
+	    long pageOffset = (offset + page) % chrSize;
+	    if (pages[(addr + page) >> 10] != chr + pageOffset) {
+		// rewriting the same bank leaves anything decoded valid
+		++generation;
+	    }
+	    pages[(addr + page) >> 10] = chr + pageOffset;
+	    offsets[(addr + page) >> 10] = pageOffset;
+	}
+    }
+
+private:
+    const uint8_t *pages[CHR_PAGE_COUNT];
+    long offsets[CHR_PAGE_COUNT];
+    const uint8_t *chr;
+    long chrSize;
+    // backs the pattern tables until a cart is loaded
+    uint8_t empty[CHR_PAGE_SIZE];
+    uint32_t generation;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <cstdint>
+
+#include <Compositor.h>
+#include <Palette.h>
+
+#ifdef COMPOSITOR_SIMD
+#include <immintrin.h>
+#endif
+
+static int composeScalar(const uint8_t *bgLine, const uint8_t *sprLine, uint8_t *out)
+{
+    int spr0Hit = -1;
+    for (int x = 0; x < LINE_WIDTH; ++x) {
+	uint8_t bg = bgLine[x];
+	uint8_t spr = sprLine[x];
+	bool bgOpaque = (bg & 0x3) != 0;
+	if (spr && (!(spr & SPR_LINE_BEHIND_BG) || !bgOpaque)) {
+	    out[x] = spr & 0x1F;
+	} else {
+	    out[x] = bgOpaque ? bg : 0;
+	}
+	if ((spr & SPR_LINE_SPRITE_0) && bgOpaque && spr0Hit < 0) {
+	    spr0Hit = x;
+	}
+    }
+    return spr0Hit;
+}
+
+static void expandScalar(const uint16_t *indices, uint32_t *colours, int count)
+{
+    for (int i = 0; i < count; ++i) {
+	colours[i] = emphasisPalette[indices[i]];
+    }
+}
+
+#ifdef COMPOSITOR_SIMD
+
+__attribute__((target("sse2")))
+static int composeSse2(const uint8_t *bgLine, const uint8_t *sprLine, uint8_t *out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bgMask = _mm_set1_epi8(0x3);
+    const __m128i indexMask = _mm_set1_epi8(0x1F);
+    const __m128i behind = _mm_set1_epi8(SPR_LINE_BEHIND_BG);
+    const __m128i spr0 = _mm_set1_epi8(SPR_LINE_SPRITE_0);
+    int spr0Hit = -1;
+    for (int x = 0; x < LINE_WIDTH; x += 16) {
+	__m128i bg = _mm_loadu_si128((const __m128i *)(bgLine + x));
+	__m128i spr = _mm_loadu_si128((const __m128i *)(sprLine + x));
+	__m128i bgClear = _mm_cmpeq_epi8(_mm_and_si128(bg, bgMask), zero);
+	__m128i sprClear = _mm_cmpeq_epi8(spr, zero);
+	__m128i sprFront = _mm_cmpeq_epi8(_mm_and_si128(spr, behind), zero);
+	// opaque sprite pixels, unless behind an opaque background pixel
+	__m128i useSpr = _mm_andnot_si128(sprClear, _mm_or_si128(sprFront, bgClear));
+	__m128i result = _mm_or_si128(_mm_and_si128(useSpr, _mm_and_si128(spr, indexMask)),
+				      _mm_andnot_si128(useSpr, _mm_andnot_si128(bgClear, bg)));
+	_mm_storeu_si128((__m128i *)(out + x), result);
+	if (spr0Hit < 0) {
+	    __m128i hit = _mm_andnot_si128(bgClear, _mm_cmpeq_epi8(_mm_and_si128(spr, spr0), spr0));
+	    int mask = _mm_movemask_epi8(hit);
+	    if (mask) {
+		spr0Hit = x + __builtin_ctz(mask);
+	    }
+	}
+    }
+    return spr0Hit;
+}
+
+__attribute__((target("avx2")))
+static int composeAvx2(const uint8_t *bgLine, const uint8_t *sprLine, uint8_t *out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bgMask = _mm256_set1_epi8(0x3);
+    const __m256i indexMask = _mm256_set1_epi8(0x1F);
+    const __m256i behind = _mm256_set1_epi8(SPR_LINE_BEHIND_BG);
+    const __m256i spr0 = _mm256_set1_epi8(SPR_LINE_SPRITE_0);
+    int spr0Hit = -1;
+    for (int x = 0; x < LINE_WIDTH; x += 32) {
+	__m256i bg = _mm256_loadu_si256((const __m256i *)(bgLine + x));
+	__m256i spr = _mm256_loadu_si256((const __m256i *)(sprLine + x));
+	__m256i bgClear = _mm256_cmpeq_epi8(_mm256_and_si256(bg, bgMask), zero);
+	__m256i sprClear = _mm256_cmpeq_epi8(spr, zero);
+	__m256i sprFront = _mm256_cmpeq_epi8(_mm256_and_si256(spr, behind), zero);
+	__m256i useSpr = _mm256_andnot_si256(sprClear, _mm256_or_si256(sprFront, bgClear));
+	__m256i result = _mm256_blendv_epi8(_mm256_andnot_si256(bgClear, bg),
+					    _mm256_and_si256(spr, indexMask), useSpr);
+	_mm256_storeu_si256((__m256i *)(out + x), result);
+	if (spr0Hit < 0) {
+	    __m256i hit = _mm256_andnot_si256(bgClear,
+					      _mm256_cmpeq_epi8(_mm256_and_si256(spr, spr0), spr0));
+	    unsigned mask = _mm256_movemask_epi8(hit);
+	    if (mask) {
+		spr0Hit = x + __builtin_ctz(mask);
+	    }
+	}
+    }
+    return spr0Hit;
+}
+
+__attribute__((target("avx2")))
+static void expandAvx2(const uint16_t *indices, uint32_t *colours, int count)
+{
+    for (int i = 0; i < count; i += 8) {
+	__m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(indices + i)));
+	__m256i colour = _mm256_i32gather_epi32((const int *)emphasisPalette, index, 4);
+	_mm256_storeu_si256((__m256i *)(colours + i), colour);
+    }
+}
+
+#endif
+
+Compositor::Compositor() : function(composeScalar),
+			   expandFunction(expandScalar),
+			   name("scalar")
+{
+#ifdef COMPOSITOR_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	function = composeAvx2;
+	expandFunction = expandAvx2;
+	name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+	function = composeSse2;
+	name = "sse2";
+    }
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <cstdint>
+
+/*
+ * Notes:
+ *
+ * - The ppu draws a scanline as two lines of palette indices, one for
+ * the background and one for the sprites, which are then merged a whole
+ * line at a time. Transparent sprite pixels are 0 in the sprite line,
+ * and opaque ones carry flags above their 5 bit palette index.
+ *
+ * - Merging is done with SSE2 or AVX2 where the host has them, picked
+ * at run time with cpuid, with a plain loop as the fallback. Building
+ * with PPU_SCALAR_COMPOSITOR always uses the plain loop, for comparing.
+ *
+ * - Frames kept as emphasisPalette indices (see Palette.h) are turned
+ * into colours by expand, with AVX2 gathers where available.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(PPU_SCALAR_COMPOSITOR)
+#define COMPOSITOR_SIMD
+#endif
+
+static const int LINE_WIDTH = 256;
+
+// sprite line flags
+static const uint8_t SPR_LINE_BEHIND_BG = 0x20;
+static const uint8_t SPR_LINE_SPRITE_0  = 0x40;
+
+// writes the palette index seen at each pixel to out, returning the
+// first x where sprite 0 is over an opaque background pixel, or -1
+typedef int (*ComposeFunction)(const uint8_t *bgLine, const uint8_t *sprLine, uint8_t *out);
+// looks up count emphasisPalette indices, a multiple of 8
+typedef void (*ExpandFunction)(const uint16_t *indices, uint32_t *colours, int count);
+
+class Compositor
+{
+public:
+    Compositor();
+    int compose(const uint8_t *bgLine, const uint8_t *sprLine, uint8_t *out) {
+	return function(bgLine, sprLine, out);
+    }
+    void expand(const uint16_t *indices, uint32_t *colours, int count) {
+	expandFunction(indices, colours, count);
+    }
+    // which implementation was picked
+    const char *getName() { return name; }
+
+private:
+    ComposeFunction function;
+    ExpandFunction expandFunction;
+    const char *name;
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include <istream>
 #include <string>
 #include <functional>
 #include <vector>
@@ -8,18 +9,62 @@
 #include <APU.h>
 #include <PPU.h>
 #include <Cart.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
 #include <Controller.h>
-#include <Divider.h>
+#include <Scheduler.h>
+#include <ppus/DotPPU.h>
+#include <ppus/ScanlinePPU.h>
 
-Console::Console() : cpuDivider(3),
-                     cpu([this] (uint16_t addr) { return cpuRead(addr); },
-                         [this] (uint16_t addr, uint8_t data) { cpuWrite(addr,data); }),
-                     ppu(&cart, [this] () { cpu.signalNMI(); }) { }
+Console::Console() : cart(&memoryMap, &chrMap, &nameTableMap),
+#ifdef CPU_FUNCTION_BUS
+                     cpuBus([this] (uint16_t addr) { return cpuRead(addr); },
+                            [this] (uint16_t addr, uint8_t data) { cpuWrite(addr,data); }),
+                     cpu(cpuBus)
+#else
+                     cpu(*this)
+#endif
+{
+    setPpuBackend(PPU_BACKEND_SCANLINE);
+    // 2KB of internal ram, mirrored up to 0x2000
+    for (int addr = 0x0000; addr < 0x2000; addr += cpuRam.size()) {
+        memoryMap.map(addr, cpuRam.size(), cpuRam.data());
+    }
+}
 
 void Console::reset()
 {
     cpu.reset();
-    ppu.reset();
+    ppu->reset();
+    scheduler.reset();
+    scheduler.schedule(EVENT_PPU, ppu->getNextEventTime());
+}
+
+void Console::setPpuBackend(PpuBackend backend)
+{
+    NMI nmi = [this] () { cpu.signalNMI(); };
+    bool indexed = ppu && ppu->getIndexedOutput();
+    switch (backend) {
+    case PPU_BACKEND_SCANLINE:
+	ppu = std::unique_ptr<PPU>(new ScanlinePPU(&cart, &chrMap, &nameTableMap, nmi));
+	break;
+    case PPU_BACKEND_DOT:
+	ppu = std::unique_ptr<PPU>(new DotPPU(&cart, &chrMap, &nameTableMap, nmi));
+	break;
+    }
+    ppu->setIndexedOutput(indexed);
+    ppu->reset();
+    scheduler.schedule(EVENT_PPU, ppu->getNextEventTime());
+}
+
+bool Console::frameChanged()
+{
+    return ppu->frameChanged();
+}
+
+const char *Console::getPpuName()
+{
+    return ppu->getName();
 }
 
 void Console::loadINesFile(std::string fileName)
@@ -28,9 +73,25 @@ void Console::loadINesFile(std::string fileName)
     reset();
 }
 
+void Console::loadINesStream(std::istream& stream)
+{
+    cart.loadStream(stream);
+    reset();
+}
+
 uint32_t *Console::getFrameBuffer()
 {
-    return ppu.getFrameBuffer();
+    return ppu->getFrameBuffer();
+}
+
+void Console::setIndexedFrameOutput(bool indexed)
+{
+    ppu->setIndexedOutput(indexed);
+}
+
+const uint16_t *Console::getIndexedFrameBuffer()
+{
+    return ppu->getIndexedFrameBuffer();
 }
 
 std::vector<short> Console::getAvailableSamples()
@@ -38,38 +99,83 @@ std::vector<short> Console::getAvailableSamples()
     return apu.getAvailableSamples();
 }
 
-void Console::runForOneFrame()
+uint64_t Console::getCpuCycles()
 {
+    return cpu.getCycles();
+}
+
+uint64_t Console::getCpuInstructionCount()
+{
+    return cpu.getInstructionCount();
+}
+
+bool Console::writeCpuTrace(std::ostream& out)
+{
+    return cpu.writeTrace(out);
+}
+
+bool Console::writeCpuProfile(std::ostream& summary, std::ostream& stacks)
+{
+    return cpu.writeProfile(summary, stacks);
+}
+
+void Console::runForOneFrame(bool render)
+{
+    ppu->setRenderSkipped(!render);
     do {
-        tick();
-    } while (!ppu.endOfFrame());
+        uint64_t eventTime = scheduler.getNextEventTime();
+        runCpuUntil(eventTime);
+        handleEvents(eventTime);
+    } while (!ppu->endOfFrame());
     apu.endFrame();
 }
 
-void Console::tick()
+uint64_t Console::getCpuTime()
 {
-    cpuDivider.tick();
-    if (cpuDivider.hasClocked()) {
-	cpu.tick();
+    // the cpu is clocked on every third master clock tick, ahead of
+    // the ppu dot of the same tick
+    return (cpu.getCycles() + 1) * MASTER_CYC_PER_CPU_CYC;
+}
+
+void Console::runCpuUntil(uint64_t time)
+{
+    // instructions starting on the same tick as an event run before it
+    uint64_t now = getCpuTime();
+    if (now <= time) {
+        cpu.run((time - now) / MASTER_CYC_PER_CPU_CYC + 1);
     }
-    ppu.tick();
 }
 
-uint8_t Console::cpuRead(uint16_t addr)
+void Console::handleEvents(uint64_t time)
+{
+    if (scheduler.isDue(EVENT_PPU, time)) {
+        ppu->runUntil(time);
+        scheduler.schedule(EVENT_PPU, ppu->getNextEventTime());
+    }
+}
+
+void Console::syncPpu()
+{
+    // bring the ppu up to, but not including, the current cpu tick
+    ppu->runUntil(getCpuTime() - 1);
+}
+
+uint8_t Console::cpuReadUnmapped(uint16_t addr)
 {
     if (addr < 0x2000) {
         return cpuRam[addr & 0x07FF];
     } else if (addr < 0x4000) {
+        syncPpu();
         int registerAddr = addr & 0x2007;
         switch (registerAddr) {
         case 0x2000: return cpuBusMDR;
         case 0x2001: return cpuBusMDR;
-        case 0x2002: return ppu.getSTATUS();
+        case 0x2002: return ppu->getSTATUS();
         case 0x2003: return cpuBusMDR;
-        case 0x2004: return ppu.getOAMDATA();
+        case 0x2004: return ppu->getOAMDATA();
         case 0x2005: return cpuBusMDR;
         case 0x2006: return cpuBusMDR;
-        case 0x2007: return ppu.getDATA();
+        case 0x2007: return ppu->getDATA();
         }
     } else if (addr < 0x4018) {
 	switch (addr) {
@@ -86,31 +192,42 @@ uint8_t Console::cpuRead(uint16_t addr)
     return 0;
 }
 
-void Console::cpuWrite(uint16_t addr, uint8_t value)
+void Console::cpuWriteUnmapped(uint16_t addr, uint8_t value)
 {
     cpuBusMDR = value;
     if (addr < 0x2000) {
         cpuRam[addr & 0x07FF] = value;
     } else if (addr < 0x4000) {
+        syncPpu();
         int registerAddr = addr & 0x2007;
         switch (registerAddr) {
-        case 0x2000: ppu.setCTRL(value); break;
-        case 0x2001: ppu.setMASK(value); break;
+        case 0x2000: ppu->setCTRL(value); break;
+        case 0x2001: ppu->setMASK(value); break;
         case 0x2002: break; // ppu status, read-only
-        case 0x2003: ppu.setOAMADDR(value); break;
-        case 0x2004: ppu.setOAMDATA(value); break;
-        case 0x2005: ppu.setSCROLL(value); break;
-        case 0x2006: ppu.setADDR(value); break;
-        case 0x2007: ppu.setDATA(value); break;
+        case 0x2003: ppu->setOAMADDR(value); break;
+        case 0x2004: ppu->setOAMDATA(value); break;
+        case 0x2005: ppu->setSCROLL(value); break;
+        case 0x2006: ppu->setADDR(value); break;
+        case 0x2007: ppu->setDATA(value); break;
         }
     } else if (addr < 0x4018) {
 	switch (addr) {
 	case 0x4014: {
+	    syncPpu();
 	    uint16_t startAddr = ((uint16_t)value) << 8;
-	    for (int i = 0; i < 256; ++i) {
-		ppu.setOAMDATA(cpuRead(startAddr + i));
+	    const uint8_t *page = memoryMap.getReadPage(startAddr);
+	    if (page) {
+		ppu->writeOAMPage(page);
+	    } else {
+		// registers and mapper handlers, read a byte at a time
+		for (int i = 0; i < 256; ++i) {
+		    ppu->setOAMDATA(cpuRead(startAddr + i));
+		}
 	    }
-	    cpu.suspend(514);
+	    // 512 cycles of reads and writes, after a cycle to halt the cpu
+	    // and another to line up with a read cycle if it halted on a
+	    // write one. DMA starts on the cycle after the write.
+	    cpu.suspend(513 + ((cpu.getWriteCycle() + 1) & 1));
 	} break;
 	case 0x4016: controller1.setStrobe(!!(value & 0x1)); break;
 	default: apu.writeRegister(addr, value); break;
@@ -118,6 +235,14 @@ void Console::cpuWrite(uint16_t addr, uint8_t value)
     } else if (addr < 0x4020) {
 	return; // disabled/unused APU test registers
     } else {
+        // mapper writes can switch chr banks and mirroring mid-frame
+        syncPpu();
+        uint32_t chrGeneration = chrMap.getGeneration();
+        uint32_t nameTableGeneration = nameTableMap.getGeneration();
         cart.writePrg(addr, value);
+        if (chrMap.getGeneration() != chrGeneration ||
+            nameTableMap.getGeneration() != nameTableGeneration) {
+            ppu->videoStateChanged();
+        }
     }
 }
@@ -1,15 +1,23 @@
 #ifndef CONSOLE_H
 #define CONSOLE_H
 
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
 #include <Cart.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
+#include <NameTableMap.h>
 #include <Controller.h>
 #include <CPU.h>
 #include <PPU.h>
 #include <APU.h>
-#include <Divider.h>
+#include <Scheduler.h>
 
 class Console
 {
@@ -17,25 +25,87 @@ public:
     Console();
     void reset();
     void loadINesFile(std::string fileName);
+    void loadINesStream(std::istream& stream);
+    // switches to another ppu, reset, for games that need the accuracy
+    // of the dot backend (see PPU.h)
+    void setPpuBackend(PpuBackend backend);
+    const char *getPpuName();
     uint32_t *getFrameBuffer();
+    // keep frames as emphasisPalette indices, see PPU::setIndexedOutput
+    void setIndexedFrameOutput(bool indexed);
+    const uint16_t *getIndexedFrameBuffer();
     std::vector<short> getAvailableSamples();
-    void runForOneFrame();
+    // without render, the frame is run as usual but not drawn, leaving
+    // the last one in the frame buffer
+    void runForOneFrame(bool render = true);
+    // whether that frame differs from the one before; if not, it was
+    // never drawn, and the frame buffer was left as it was
+    bool frameChanged();
+    uint64_t getCpuCycles();
+    uint64_t getCpuInstructionCount();
+    bool writeCpuTrace(std::ostream& out);
+    bool writeCpuProfile(std::ostream& summary, std::ostream& stacks);
 
     Controller controller1;
     APU apu;
 
 private:
-    void tick();
+    friend class CPU<Console>;
+
+    uint64_t getCpuTime();
+    void runCpuUntil(uint64_t time);
+    void handleEvents(uint64_t time);
+    void syncPpu();
     uint8_t cpuRead(uint16_t addr);
     void cpuWrite(uint16_t addr, uint8_t data);
+    uint8_t cpuReadUnmapped(uint16_t addr);
+    void cpuWriteUnmapped(uint16_t addr, uint8_t data);
+    const uint8_t *getReadPage(uint16_t addr) { return memoryMap.getReadPage(addr); }
+    uint8_t *getWritePage(uint16_t addr) { return memoryMap.getWritePage(addr); }
+    uint32_t getMapGeneration() { return memoryMap.getGeneration(); }
+    // memory, or ppu status when it only changes on ppu events and so not
+    // within a runCpuUntil(); reading it again just clears vblank again
+    bool isStableRead(uint16_t addr) {
+        return memoryMap.getReadPage(addr) ||
+	    ((addr & 0xE007) == 0x2002 && ppu->isStatusStable());
+    }
+    int getPrgBank(uint16_t addr) { return cart.getPrgBank(memoryMap.getReadPage(addr)); }
 
     std::array<uint8_t, 0x800> cpuRam{0};
     uint8_t cpuBusMDR;
 
-    Divider cpuDivider;
+    Scheduler scheduler;
+    MemoryMap memoryMap;
+    ChrMap chrMap;
+    NameTableMap nameTableMap;
     Cart cart;
-    CPU cpu;
-    PPU ppu;
+#ifdef CPU_FUNCTION_BUS
+    FunctionBus cpuBus;
+    CPU<FunctionBus> cpu;
+#else
+    CPU<Console> cpu;
+#endif
+    std::unique_ptr<PPU> ppu;
 };
 
+inline uint8_t Console::cpuRead(uint16_t addr)
+{
+    const uint8_t *page = memoryMap.getReadPage(addr);
+    if (page) {
+        return page[addr & 0xFF];
+    }
+    return cpuReadUnmapped(addr);
+}
+
+inline void Console::cpuWrite(uint16_t addr, uint8_t value)
+{
+    uint8_t *page = memoryMap.getWritePage(addr);
+    if (page) {
+        cpuBusMDR = value;
+        page[addr & 0xFF] = value;
+        return;
+    }
+    cpuWriteUnmapped(addr, value);
+}
+
 #endif
@@ -27,10 +27,12 @@ void GUI::clearRenderTarget()
     SDL_RenderClear(renderer);
 }
 
-void GUI::renderAndDisplayFrame(uint32_t *frameBuffer)
+void GUI::renderAndDisplayFrame(uint32_t *frameBuffer, bool frameChanged)
 {
     // apply frame buffer data to texture
-    SDL_UpdateTexture(frameTexture, NULL, frameBuffer, GUI_TEXTURE_WIDTH * sizeof(uint32_t));
+    if (frameChanged) {
+	SDL_UpdateTexture(frameTexture, NULL, frameBuffer, GUI_TEXTURE_WIDTH * sizeof(uint32_t));
+    }
     // render the texture
     SDL_RenderCopy(renderer, frameTexture, NULL, NULL);
     // finally present render target to the window
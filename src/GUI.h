@@ -17,7 +17,8 @@ public:
     ~GUI();
 
     void clearRenderTarget();
-    void renderAndDisplayFrame(uint32_t *frameBuffer);
+    // the texture is only updated if the frame has changed
+    void renderAndDisplayFrame(uint32_t *frameBuffer, bool frameChanged = true);
 
 private:
     SDL_Window *window;
@@ -5,20 +5,51 @@
 #include <vector>
 
 #include <CartMemory.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
 #include <Mirroring.h>
+#include <NameTableMap.h>
 
 class Mapper
 {
 public:
-    Mapper(CartMemory mem) : cartMemory(mem) { };
+    Mapper(CartMemory mem, MemoryMap *memoryMap, ChrMap *chrMap,
+           NameTableMap *nameTableMap) : cartMemory(mem),
+                                         memoryMap(memoryMap),
+                                         chrMap(chrMap),
+                                         nameTableMap(nameTableMap) {
+        nameTableMap->setMirroring(cartMemory.mirroring, cartMemory.nameTableRam.data());
+    };
     Mirroring getMirroring() { return cartMemory.mirroring; };
     virtual uint8_t readPrg(uint16_t addr) { return 0; };
     virtual void writePrg(uint16_t addr, uint8_t value) { };
     virtual uint8_t readChr(uint16_t addr) { return 0; };
     virtual void writeChr(uint16_t addr, uint8_t value) { };
+    // the ppu's A12 address line rising, as counted by scanline counters.
+    // Only DotPPU reports these.
+    virtual void clockA12() { };
+    // offset into prg rom of host memory mem, or -1 if it's elsewhere
+    long getPrgOffset(const uint8_t *mem) {
+        const uint8_t *prg = cartMemory.prg.data();
+        if (!mem || mem < prg || mem >= prg + cartMemory.prg.size()) {
+            return -1;
+        }
+        return mem - prg;
+    };
 
 protected:
+    // four screen carts have their own ram in place of the mapper's mirroring
+    void setMirroring(Mirroring mirroring) {
+        if (cartMemory.mirroring != MIRROR_FOUR_SCREEN) {
+            cartMemory.mirroring = mirroring;
+            nameTableMap->setMirroring(mirroring, NULL);
+        }
+    };
+
     CartMemory cartMemory;
+    MemoryMap *memoryMap;
+    ChrMap *chrMap;
+    NameTableMap *nameTableMap;
 };
 
 #endif
@@ -0,0 +1,65 @@
+#ifndef MEMORY_MAP_H
+#define MEMORY_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Notes:
+ *
+ * - The cpu address space is split into 256 byte pages. Each page has
+ * a read pointer and a write pointer to the memory backing it, or NULL
+ * if accesses must go through the slower register/mapper handlers.
+ *
+ * - Mappers remap their pages whenever they switch banks, so no
+ * address decoding is needed on the fast path.
+ */
+
+static const int CPU_PAGE_SIZE = 0x100;
+static const int CPU_PAGE_COUNT = 0x100;
+
+class MemoryMap
+{
+public:
+    MemoryMap() : generation(0) {
+	unmap(0x0000, CPU_PAGE_SIZE * CPU_PAGE_COUNT);
+    }
+    const uint8_t *getReadPage(uint16_t addr) {
+	return readPages[addr >> 8];
+    }
+    uint8_t *getWritePage(uint16_t addr) {
+	return writePages[addr >> 8];
+    }
+    // changes whenever any page is remapped
+    uint32_t getGeneration() {
+	return generation;
+    }
+    void map(int addr, int size, uint8_t *mem) {
+	++generation;
+	for (int offset = 0; offset < size; offset += CPU_PAGE_SIZE) {
+	    readPages[(addr + offset) >> 8] = mem + offset;
+	    writePages[(addr + offset) >> 8] = mem + offset;
+	}
+    }
+    void mapReadOnly(int addr, int size, const uint8_t *mem) {
+	++generation;
+	for (int offset = 0; offset < size; offset += CPU_PAGE_SIZE) {
+	    readPages[(addr + offset) >> 8] = mem + offset;
+	    writePages[(addr + offset) >> 8] = NULL;
+	}
+    }
+    void unmap(int addr, int size) {
+	++generation;
+	for (int offset = 0; offset < size; offset += CPU_PAGE_SIZE) {
+	    readPages[(addr + offset) >> 8] = NULL;
+	    writePages[(addr + offset) >> 8] = NULL;
+	}
+    }
+
+private:
+    const uint8_t *readPages[CPU_PAGE_COUNT];
+    uint8_t *writePages[CPU_PAGE_COUNT];
+    uint32_t generation;
+};
+
+#endif
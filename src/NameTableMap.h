@@ -0,0 +1,91 @@
+#ifndef NAME_TABLE_MAP_H
+#define NAME_TABLE_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <Mirroring.h>
+
+/*
+ * Notes:
+ *
+ * - The ppu's four name tables ($2000-$2FFF, mirrored up to $3EFF) are
+ * each a pointer to a 1KB page, either of the console's 2KB of vram or of
+ * ram on the cart, so the ppu reads them without asking the mapper how
+ * they're mirrored.
+ *
+ * - Mappers repoint the tables only when they change mirroring. As with
+ * ChrMap, that changes the generation.
+ *
+ * - Four screen carts bring 2KB of their own for the last two tables, and
+ * other mappers can put their own ram behind any table with map().
+ */
+
+static const int NAME_TABLE_SIZE = 0x400;
+static const int NAME_TABLE_COUNT = 4;
+
+class NameTableMap
+{
+public:
+    NameTableMap() : generation(0) {
+	for (int i = 0; i < 2 * NAME_TABLE_SIZE; ++i) {
+	    ciRam[i] = 0;
+	}
+	setMirroring(MIRROR_VERTICAL, NULL);
+    }
+    // addr is taken modulo $1000
+    uint8_t read(uint16_t addr) {
+	return tables[(addr >> 10) & (NAME_TABLE_COUNT - 1)][addr & (NAME_TABLE_SIZE - 1)];
+    }
+    void write(uint16_t addr, uint8_t value) {
+	tables[(addr >> 10) & (NAME_TABLE_COUNT - 1)][addr & (NAME_TABLE_SIZE - 1)] = value;
+    }
+    // changes whenever a table is mapped somewhere else
+    uint32_t getGeneration() {
+	return generation;
+    }
+    // cartRam is the cart's 2KB, only used for four screen mirroring
+    void setMirroring(Mirroring mirroring, uint8_t *cartRam) {
+	switch (mirroring) {
+	case MIRROR_VERTICAL:
+	    mapCiRam(0, 1, 0, 1);
+	    break;
+	case MIRROR_HORIZONTAL:
+	    mapCiRam(0, 0, 1, 1);
+	    break;
+	case MIRROR_LOWER_BANK:
+	    mapCiRam(0, 0, 0, 0);
+	    break;
+	case MIRROR_UPPER_BANK:
+	    mapCiRam(1, 1, 1, 1);
+	    break;
+	case MIRROR_FOUR_SCREEN:
+	    mapCiRam(0, 1, 0, 1);
+	    map(2, cartRam);
+	    map(3, cartRam + NAME_TABLE_SIZE);
+	    break;
+	}
+    }
+    // a 1KB page of the cart's for the given table
+    void map(int table, uint8_t *page) {
+	if (tables[table] != page) {
+	    ++generation;
+	    tables[table] = page;
+	}
+    }
+
+private:
+    void mapCiRam(int page0, int page1, int page2, int page3) {
+	map(0, ciRam + page0 * NAME_TABLE_SIZE);
+	map(1, ciRam + page1 * NAME_TABLE_SIZE);
+	map(2, ciRam + page2 * NAME_TABLE_SIZE);
+	map(3, ciRam + page3 * NAME_TABLE_SIZE);
+    }
+
+    uint8_t *tables[NAME_TABLE_COUNT] = {NULL};
+    // the console's own vram
+    uint8_t ciRam[2 * NAME_TABLE_SIZE];
+    uint32_t generation;
+};
+
+#endif
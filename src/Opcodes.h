@@ -0,0 +1,408 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <cstdint>
+
+enum AddrMode
+{
+    AM_ABS,
+    AM_ABX,
+    AM_ABY,
+    AM_ACC,
+    AM_IMM,
+    AM_IMP,
+    AM_IND,
+    AM_INX,
+    AM_INY,
+    AM_REL,
+    AM_ZPG,
+    AM_ZPX,
+    AM_ZPY,
+};
+
+enum Operation
+{
+    OP_ADC,
+    OP_AND,
+    OP_ASL,
+    OP_BRK,
+    OP_BCC,
+    OP_BCS,
+    OP_BEQ,
+    OP_BIT,
+    OP_BMI,
+    OP_BNE,
+    OP_BPL,
+    OP_BVC,
+    OP_BVS,
+    OP_CLC,
+    OP_CLD,
+    OP_CLI,
+    OP_CLV,
+    OP_CMP,
+    OP_CPX,
+    OP_CPY,
+    OP_DEC,
+    OP_DEX,
+    OP_DEY,
+    OP_EOR,
+    OP_INC,
+    OP_INX,
+    OP_INY,
+    OP_JMP,
+    OP_JSR,
+    OP_LDA,
+    OP_LDX,
+    OP_LDY,
+    OP_LSR,
+    OP_NOP,
+    OP_ORA,
+    OP_PHA,
+    OP_PHP,
+    OP_PLA,
+    OP_PLP,
+    OP_ROL,
+    OP_ROR,
+    OP_RTI,
+    OP_RTS,
+    OP_SBC,
+    OP_SEC,
+    OP_SED,
+    OP_SEI,
+    OP_STA,
+    OP_STX,
+    OP_STY,
+    OP_TAX,
+    OP_TAY,
+    OP_TSX,
+    OP_TXA,
+    OP_TXS,
+    OP_TYA,
+    // undocumented ops
+    OP_JAM,
+    OP_SLO,
+    OP_DOP,
+    OP_ANC,
+    OP_TOP,
+    OP_RLA,
+    OP_SRE,
+    OP_ALR,
+    OP_RRA,
+    OP_ARR,
+    OP_SAX,
+    OP_XAA,
+    OP_AHX,
+    OP_XAS,
+    OP_SHY,
+    OP_SHX,
+    OP_LAX,
+    OP_LAR,
+    OP_DCP,
+    OP_AXS,
+    OP_ISC,
+};
+
+// mnemonics by Operation
+static const char *const OPERATION_NAMES[] = {
+    "ADC", "AND", "ASL", "BRK", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE",
+    "BPL", "BVC", "BVS", "CLC", "CLD", "CLI", "CLV", "CMP", "CPX", "CPY",
+    "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP", "JSR", "LDA",
+    "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL",
+    "ROR", "RTI", "RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY",
+    "TAX", "TAY", "TSX", "TXA", "TXS", "TYA",
+    // undocumented ops, named as nestest.log does where it has them
+    "JAM", "SLO", "NOP", "ANC", "NOP", "RLA", "SRE", "ALR", "RRA", "ARR",
+    "SAX", "XAA", "AHX", "XAS", "SHY", "SHX", "LAX", "LAR", "DCP", "AXS",
+    "ISB",
+};
+
+struct Opcode
+{
+    AddrMode mode;
+    Operation operation;
+    // cycles taken, not counting page crossing or taken branches
+    uint8_t cycles;
+    // indexed reads that cross a page take an extra cycle and do a
+    // dummy read from the unfixed address
+    bool pageCrossPenalty;
+};
+
+// bytes following the opcode
+constexpr int getOperandLength(AddrMode mode)
+{
+    return (mode == AM_ABS || mode == AM_ABX || mode == AM_ABY || mode == AM_IND) ? 2 :
+	   (mode == AM_ACC || mode == AM_IMP) ? 0 : 1;
+}
+
+// operations that can leave pc anywhere other than the next opcode
+constexpr bool isControlFlow(Operation operation)
+{
+    return operation == OP_BCC || operation == OP_BCS || operation == OP_BEQ ||
+	   operation == OP_BMI || operation == OP_BNE || operation == OP_BPL ||
+	   operation == OP_BVC || operation == OP_BVS || operation == OP_BRK ||
+	   operation == OP_JMP || operation == OP_JSR || operation == OP_RTI ||
+	   operation == OP_RTS || operation == OP_JAM;
+}
+
+// Evaluated at compile time, so that each opcode's handler can be
+// specialised on its address mode and operation
+constexpr Opcode OPCODES[256] = {
+    /* 0x00 */ { AM_IMP, OP_BRK, 7, false },
+    /* 0x01 */ { AM_INX, OP_ORA, 6, false },
+    /* 0x02 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x03 */ { AM_INX, OP_SLO, 8, false },
+    /* 0x04 */ { AM_ZPG, OP_DOP, 3, false },
+    /* 0x05 */ { AM_ZPG, OP_ORA, 3, false },
+    /* 0x06 */ { AM_ZPG, OP_ASL, 5, false },
+    /* 0x07 */ { AM_ZPG, OP_SLO, 5, false },
+    /* 0x08 */ { AM_IMP, OP_PHP, 3, false },
+    /* 0x09 */ { AM_IMM, OP_ORA, 2, false },
+    /* 0x0A */ { AM_ACC, OP_ASL, 2, false },
+    /* 0x0B */ { AM_IMM, OP_ANC, 2, false },
+    /* 0x0C */ { AM_ABS, OP_TOP, 4, false },
+    /* 0x0D */ { AM_ABS, OP_ORA, 4, false },
+    /* 0x0E */ { AM_ABS, OP_ASL, 6, false },
+    /* 0x0F */ { AM_ABS, OP_SLO, 6, false },
+    /* 0x10 */ { AM_REL, OP_BPL, 2, false },
+    /* 0x11 */ { AM_INY, OP_ORA, 5, true },
+    /* 0x12 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x13 */ { AM_INY, OP_SLO, 8, false },
+    /* 0x14 */ { AM_ZPX, OP_DOP, 4, false },
+    /* 0x15 */ { AM_ZPX, OP_ORA, 4, false },
+    /* 0x16 */ { AM_ZPX, OP_ASL, 6, false },
+    /* 0x17 */ { AM_ZPX, OP_SLO, 6, false },
+    /* 0x18 */ { AM_IMP, OP_CLC, 2, false },
+    /* 0x19 */ { AM_ABY, OP_ORA, 4, true },
+    /* 0x1A */ { AM_IMP, OP_NOP, 2, false },
+    /* 0x1B */ { AM_ABY, OP_SLO, 7, false },
+    /* 0x1C */ { AM_ABX, OP_TOP, 4, true },
+    /* 0x1D */ { AM_ABX, OP_ORA, 4, true },
+    /* 0x1E */ { AM_ABX, OP_ASL, 7, false },
+    /* 0x1F */ { AM_ABX, OP_SLO, 7, false },
+    /* 0x20 */ { AM_ABS, OP_JSR, 6, false },
+    /* 0x21 */ { AM_INX, OP_AND, 6, false },
+    /* 0x22 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x23 */ { AM_INX, OP_RLA, 8, false },
+    /* 0x24 */ { AM_ZPG, OP_BIT, 3, false },
+    /* 0x25 */ { AM_ZPG, OP_AND, 3, false },
+    /* 0x26 */ { AM_ZPG, OP_ROL, 5, false },
+    /* 0x27 */ { AM_ZPG, OP_RLA, 5, false },
+    /* 0x28 */ { AM_IMP, OP_PLP, 4, false },
+    /* 0x29 */ { AM_IMM, OP_AND, 2, false },
+    /* 0x2A */ { AM_ACC, OP_ROL, 2, false },
+    /* 0x2B */ { AM_IMM, OP_ANC, 2, false },
+    /* 0x2C */ { AM_ABS, OP_BIT, 4, false },
+    /* 0x2D */ { AM_ABS, OP_AND, 4, false },
+    /* 0x2E */ { AM_ABS, OP_ROL, 6, false },
+    /* 0x2F */ { AM_ABS, OP_RLA, 6, false },
+    /* 0x30 */ { AM_REL, OP_BMI, 2, false },
+    /* 0x31 */ { AM_INY, OP_AND, 5, true },
+    /* 0x32 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x33 */ { AM_INY, OP_RLA, 8, false },
+    /* 0x34 */ { AM_ZPX, OP_DOP, 4, false },
+    /* 0x35 */ { AM_ZPX, OP_AND, 4, false },
+    /* 0x36 */ { AM_ZPX, OP_ROL, 6, false },
+    /* 0x37 */ { AM_ZPX, OP_RLA, 6, false },
+    /* 0x38 */ { AM_IMP, OP_SEC, 2, false },
+    /* 0x39 */ { AM_ABY, OP_AND, 4, true },
+    /* 0x3A */ { AM_IMP, OP_NOP, 2, false },
+    /* 0x3B */ { AM_ABY, OP_RLA, 7, false },
+    /* 0x3C */ { AM_ABX, OP_TOP, 4, true },
+    /* 0x3D */ { AM_ABX, OP_AND, 4, true },
+    /* 0x3E */ { AM_ABX, OP_ROL, 7, false },
+    /* 0x3F */ { AM_ABX, OP_RLA, 7, false },
+    /* 0x40 */ { AM_IMP, OP_RTI, 6, false },
+    /* 0x41 */ { AM_INX, OP_EOR, 6, false },
+    /* 0x42 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x43 */ { AM_INX, OP_SRE, 8, false },
+    /* 0x44 */ { AM_ZPG, OP_DOP, 3, false },
+    /* 0x45 */ { AM_ZPG, OP_EOR, 3, false },
+    /* 0x46 */ { AM_ZPG, OP_LSR, 5, false },
+    /* 0x47 */ { AM_ZPG, OP_SRE, 5, false },
+    /* 0x48 */ { AM_IMP, OP_PHA, 3, false },
+    /* 0x49 */ { AM_IMM, OP_EOR, 2, false },
+    /* 0x4A */ { AM_ACC, OP_LSR, 2, false },
+    /* 0x4B */ { AM_IMM, OP_ALR, 2, false },
+    /* 0x4C */ { AM_ABS, OP_JMP, 3, false },
+    /* 0x4D */ { AM_ABS, OP_EOR, 4, false },
+    /* 0x4E */ { AM_ABS, OP_LSR, 6, false },
+    /* 0x4F */ { AM_ABS, OP_SRE, 6, false },
+    /* 0x50 */ { AM_REL, OP_BVC, 2, false },
+    /* 0x51 */ { AM_INY, OP_EOR, 5, true },
+    /* 0x52 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x53 */ { AM_INY, OP_SRE, 8, false },
+    /* 0x54 */ { AM_ZPX, OP_DOP, 4, false },
+    /* 0x55 */ { AM_ZPX, OP_EOR, 4, false },
+    /* 0x56 */ { AM_ZPX, OP_LSR, 6, false },
+    /* 0x57 */ { AM_ZPX, OP_SRE, 6, false },
+    /* 0x58 */ { AM_IMP, OP_CLI, 2, false },
+    /* 0x59 */ { AM_ABY, OP_EOR, 4, true },
+    /* 0x5A */ { AM_IMP, OP_NOP, 2, false },
+    /* 0x5B */ { AM_ABY, OP_SRE, 7, false },
+    /* 0x5C */ { AM_ABX, OP_TOP, 4, true },
+    /* 0x5D */ { AM_ABX, OP_EOR, 4, true },
+    /* 0x5E */ { AM_ABX, OP_LSR, 7, false },
+    /* 0x5F */ { AM_ABX, OP_SRE, 7, false },
+    /* 0x60 */ { AM_IMP, OP_RTS, 6, false },
+    /* 0x61 */ { AM_INX, OP_ADC, 6, false },
+    /* 0x62 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x63 */ { AM_INX, OP_RRA, 8, false },
+    /* 0x64 */ { AM_ZPG, OP_DOP, 3, false },
+    /* 0x65 */ { AM_ZPG, OP_ADC, 3, false },
+    /* 0x66 */ { AM_ZPG, OP_ROR, 5, false },
+    /* 0x67 */ { AM_ZPG, OP_RRA, 5, false },
+    /* 0x68 */ { AM_IMP, OP_PLA, 4, false },
+    /* 0x69 */ { AM_IMM, OP_ADC, 2, false },
+    /* 0x6A */ { AM_ACC, OP_ROR, 2, false },
+    /* 0x6B */ { AM_IMM, OP_ARR, 2, false },
+    /* 0x6C */ { AM_IND, OP_JMP, 5, false },
+    /* 0x6D */ { AM_ABS, OP_ADC, 4, false },
+    /* 0x6E */ { AM_ABS, OP_ROR, 6, false },
+    /* 0x6F */ { AM_ABS, OP_RRA, 6, false },
+    /* 0x70 */ { AM_REL, OP_BVS, 2, false },
+    /* 0x71 */ { AM_INY, OP_ADC, 5, true },
+    /* 0x72 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x73 */ { AM_INY, OP_RRA, 8, false },
+    /* 0x74 */ { AM_ZPX, OP_DOP, 4, false },
+    /* 0x75 */ { AM_ZPX, OP_ADC, 4, false },
+    /* 0x76 */ { AM_ZPX, OP_ROR, 6, false },
+    /* 0x77 */ { AM_ZPX, OP_RRA, 6, false },
+    /* 0x78 */ { AM_IMP, OP_SEI, 2, false },
+    /* 0x79 */ { AM_ABY, OP_ADC, 4, true },
+    /* 0x7A */ { AM_IMP, OP_NOP, 2, false },
+    /* 0x7B */ { AM_ABY, OP_RRA, 7, false },
+    /* 0x7C */ { AM_ABX, OP_TOP, 4, true },
+    /* 0x7D */ { AM_ABX, OP_ADC, 4, true },
+    /* 0x7E */ { AM_ABX, OP_ROR, 7, false },
+    /* 0x7F */ { AM_ABX, OP_RRA, 7, false },
+    /* 0x80 */ { AM_IMM, OP_DOP, 2, false },
+    /* 0x81 */ { AM_INX, OP_STA, 6, false },
+    /* 0x82 */ { AM_IMM, OP_DOP, 2, false },
+    /* 0x83 */ { AM_INX, OP_SAX, 6, false },
+    /* 0x84 */ { AM_ZPG, OP_STY, 3, false },
+    /* 0x85 */ { AM_ZPG, OP_STA, 3, false },
+    /* 0x86 */ { AM_ZPG, OP_STX, 3, false },
+    /* 0x87 */ { AM_ZPG, OP_SAX, 3, false },
+    /* 0x88 */ { AM_IMP, OP_DEY, 2, false },
+    /* 0x89 */ { AM_IMM, OP_DOP, 2, false },
+    /* 0x8A */ { AM_IMP, OP_TXA, 2, false },
+    /* 0x8B */ { AM_IMM, OP_XAA, 2, false },
+    /* 0x8C */ { AM_ABS, OP_STY, 4, false },
+    /* 0x8D */ { AM_ABS, OP_STA, 4, false },
+    /* 0x8E */ { AM_ABS, OP_STX, 4, false },
+    /* 0x8F */ { AM_ABS, OP_SAX, 4, false },
+    /* 0x90 */ { AM_REL, OP_BCC, 2, false },
+    /* 0x91 */ { AM_INY, OP_STA, 6, false },
+    /* 0x92 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0x93 */ { AM_INY, OP_AHX, 6, false },
+    /* 0x94 */ { AM_ZPX, OP_STY, 4, false },
+    /* 0x95 */ { AM_ZPX, OP_STA, 4, false },
+    /* 0x96 */ { AM_ZPY, OP_STX, 4, false },
+    /* 0x97 */ { AM_ZPY, OP_SAX, 4, false },
+    /* 0x98 */ { AM_IMP, OP_TYA, 2, false },
+    /* 0x99 */ { AM_ABY, OP_STA, 5, false },
+    /* 0x9A */ { AM_IMP, OP_TXS, 2, false },
+    /* 0x9B */ { AM_ABY, OP_XAS, 5, false },
+    /* 0x9C */ { AM_ABX, OP_SHY, 5, false },
+    /* 0x9D */ { AM_ABX, OP_STA, 5, false },
+    /* 0x9E */ { AM_ABY, OP_SHX, 5, false },
+    /* 0x9F */ { AM_ABY, OP_AHX, 5, false },
+    /* 0xA0 */ { AM_IMM, OP_LDY, 2, false },
+    /* 0xA1 */ { AM_INX, OP_LDA, 6, false },
+    /* 0xA2 */ { AM_IMM, OP_LDX, 2, false },
+    /* 0xA3 */ { AM_INX, OP_LAX, 6, false },
+    /* 0xA4 */ { AM_ZPG, OP_LDY, 3, false },
+    /* 0xA5 */ { AM_ZPG, OP_LDA, 3, false },
+    /* 0xA6 */ { AM_ZPG, OP_LDX, 3, false },
+    /* 0xA7 */ { AM_ZPG, OP_LAX, 3, false },
+    /* 0xA8 */ { AM_IMP, OP_TAY, 2, false },
+    /* 0xA9 */ { AM_IMM, OP_LDA, 2, false },
+    /* 0xAA */ { AM_IMP, OP_TAX, 2, false },
+    /* 0xAB */ { AM_IMM, OP_LAX, 2, false },
+    /* 0xAC */ { AM_ABS, OP_LDY, 4, false },
+    /* 0xAD */ { AM_ABS, OP_LDA, 4, false },
+    /* 0xAE */ { AM_ABS, OP_LDX, 4, false },
+    /* 0xAF */ { AM_ABS, OP_LAX, 4, false },
+    /* 0xB0 */ { AM_REL, OP_BCS, 2, false },
+    /* 0xB1 */ { AM_INY, OP_LDA, 5, true },
+    /* 0xB2 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0xB3 */ { AM_INY, OP_LAX, 5, false },
+    /* 0xB4 */ { AM_ZPX, OP_LDY, 4, false },
+    /* 0xB5 */ { AM_ZPX, OP_LDA, 4, false },
+    /* 0xB6 */ { AM_ZPY, OP_LDX, 4, false },
+    /* 0xB7 */ { AM_ZPY, OP_LAX, 4, false },
+    /* 0xB8 */ { AM_IMP, OP_CLV, 2, false },
+    /* 0xB9 */ { AM_ABY, OP_LDA, 4, true },
+    /* 0xBA */ { AM_IMP, OP_TSX, 2, false },
+    /* 0xBB */ { AM_ABY, OP_LAR, 4, false },
+    /* 0xBC */ { AM_ABX, OP_LDY, 4, true },
+    /* 0xBD */ { AM_ABX, OP_LDA, 4, true },
+    /* 0xBE */ { AM_ABY, OP_LDX, 4, true },
+    /* 0xBF */ { AM_ABY, OP_LAX, 4, false },
+    /* 0xC0 */ { AM_IMM, OP_CPY, 2, false },
+    /* 0xC1 */ { AM_INX, OP_CMP, 6, false },
+    /* 0xC2 */ { AM_IMM, OP_DOP, 2, false },
+    /* 0xC3 */ { AM_INX, OP_DCP, 8, false },
+    /* 0xC4 */ { AM_ZPG, OP_CPY, 3, false },
+    /* 0xC5 */ { AM_ZPG, OP_CMP, 3, false },
+    /* 0xC6 */ { AM_ZPG, OP_DEC, 5, false },
+    /* 0xC7 */ { AM_ZPG, OP_DCP, 5, false },
+    /* 0xC8 */ { AM_IMP, OP_INY, 2, false },
+    /* 0xC9 */ { AM_IMM, OP_CMP, 2, false },
+    /* 0xCA */ { AM_IMP, OP_DEX, 2, false },
+    /* 0xCB */ { AM_IMM, OP_AXS, 2, false },
+    /* 0xCC */ { AM_ABS, OP_CPY, 4, false },
+    /* 0xCD */ { AM_ABS, OP_CMP, 4, false },
+    /* 0xCE */ { AM_ABS, OP_DEC, 6, false },
+    /* 0xCF */ { AM_ABS, OP_DCP, 6, false },
+    /* 0xD0 */ { AM_REL, OP_BNE, 2, false },
+    /* 0xD1 */ { AM_INY, OP_CMP, 5, true },
+    /* 0xD2 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0xD3 */ { AM_INY, OP_DCP, 8, false },
+    /* 0xD4 */ { AM_ZPX, OP_DOP, 4, false },
+    /* 0xD5 */ { AM_ZPX, OP_CMP, 4, false },
+    /* 0xD6 */ { AM_ZPX, OP_DEC, 6, false },
+    /* 0xD7 */ { AM_ZPX, OP_DCP, 6, false },
+    /* 0xD8 */ { AM_IMP, OP_CLD, 2, false },
+    /* 0xD9 */ { AM_ABY, OP_CMP, 4, true },
+    /* 0xDA */ { AM_IMP, OP_NOP, 2, false },
+    /* 0xDB */ { AM_ABY, OP_DCP, 7, false },
+    /* 0xDC */ { AM_ABX, OP_TOP, 4, true },
+    /* 0xDD */ { AM_ABX, OP_CMP, 4, true },
+    /* 0xDE */ { AM_ABX, OP_DEC, 7, false },
+    /* 0xDF */ { AM_ABX, OP_DCP, 7, false },
+    /* 0xE0 */ { AM_IMM, OP_CPX, 2, false },
+    /* 0xE1 */ { AM_INX, OP_SBC, 6, false },
+    /* 0xE2 */ { AM_IMM, OP_DOP, 2, false },
+    /* 0xE3 */ { AM_INX, OP_ISC, 8, false },
+    /* 0xE4 */ { AM_ZPG, OP_CPX, 3, false },
+    /* 0xE5 */ { AM_ZPG, OP_SBC, 3, false },
+    /* 0xE6 */ { AM_ZPG, OP_INC, 5, false },
+    /* 0xE7 */ { AM_ZPG, OP_ISC, 5, false },
+    /* 0xE8 */ { AM_IMP, OP_INX, 2, false },
+    /* 0xE9 */ { AM_IMM, OP_SBC, 2, false },
+    /* 0xEA */ { AM_IMP, OP_NOP, 2, false },
+    /* 0xEB */ { AM_IMM, OP_SBC, 2, false },
+    /* 0xEC */ { AM_ABS, OP_CPX, 4, false },
+    /* 0xED */ { AM_ABS, OP_SBC, 4, false },
+    /* 0xEE */ { AM_ABS, OP_INC, 6, false },
+    /* 0xEF */ { AM_ABS, OP_ISC, 6, false },
+    /* 0xF0 */ { AM_REL, OP_BEQ, 2, false },
+    /* 0xF1 */ { AM_INY, OP_SBC, 5, true },
+    /* 0xF2 */ { AM_IMP, OP_JAM, 0, false },
+    /* 0xF3 */ { AM_INY, OP_ISC, 8, false },
+    /* 0xF4 */ { AM_ZPX, OP_DOP, 4, false },
+    /* 0xF5 */ { AM_ZPX, OP_SBC, 4, false },
+    /* 0xF6 */ { AM_ZPX, OP_INC, 6, false },
+    /* 0xF7 */ { AM_ZPX, OP_ISC, 6, false },
+    /* 0xF8 */ { AM_IMP, OP_SED, 2, false },
+    /* 0xF9 */ { AM_ABY, OP_SBC, 4, true },
+    /* 0xFA */ { AM_IMP, OP_NOP, 2, false },
+    /* 0xFB */ { AM_ABY, OP_ISC, 7, false },
+    /* 0xFC */ { AM_ABX, OP_TOP, 4, true },
+    /* 0xFD */ { AM_ABX, OP_SBC, 4, true },
+    /* 0xFE */ { AM_ABX, OP_INC, 7, false },
+    /* 0xFF */ { AM_ABX, OP_ISC, 7, false }
+};
+
+#endif
@@ -1,18 +1,30 @@
 #include <cstdint>
-#include <cassert>
 
 #include <PPU.h>
 #include <CPU.h>
-#include <Graphics.h>
-#include <Mirroring.h>
-
-PPU::PPU(Cart *cart, NMI nmi) : cart(cart),
-                                nmi(nmi) { }
+#include <ChrMap.h>
+#include <Compositor.h>
+#include <NameTableMap.h>
+
+PPU::PPU(Cart *cart, ChrMap *chrMap, NameTableMap *nameTableMap, NMI nmi) :
+    cart(cart),
+    chrMap(chrMap),
+    nameTableMap(nameTableMap),
+    renderSkipped(false),
+    reusingFrame(false),
+    nmi(nmi),
+    indexedOutput(false),
+    staleLines(),
+    frameBufferStale(false),
+    videoGeneration(0),
+    frameGeneration(0),
+    frameRegisters(0),
+    frameReusable(false),
+    frameUpdated(true) { }
 
 void PPU::reset()
 {
     // 0x2000: CTRL
-    nameTableAddr = 0;              // 0=0x2000, 1=0x2400, 2=0x2800, 3=0x2C00
     vRamAddrIncr = false;           // 0=1 (across name table), 1=32 (down name table)
     sprPatternTableSelector = false;// 0=0x0000, 1=0x1000, ignored if bigSprites is 8x16
     bgPatternTableSelector = false; // 0=0x0000, 1=0x1000
@@ -29,6 +41,7 @@ void PPU::reset()
     buffRed = false;                // dims non red colours
     buffGreen = false;              // dims non green colours
     buffBlue = false;               // dims non blue colours
+    coloursDirty = true;
 
     // 0x2002: STATUS
     // 5 unused bits
@@ -39,12 +52,10 @@ void PPU::reset()
     // 0x2003: OAMADDR
     oamAddrBuffer = 0x00;
 
-    // 0x2005: SCROLL
-    scrollX = 0x00;
-    scrollY = 0x00;
-
-    // 0x2006: ADDR
-    addrBuffer = 0x0000;
+    // 0x2005: SCROLL, 0x2006: ADDR
+    vRamAddr = 0x0000;
+    tempVRamAddr = 0x0000;
+    fineXScroll = 0;
 
     // 0x2007: DATA
     readBuffer = 0x00;
@@ -52,30 +63,38 @@ void PPU::reset()
     // latch used for SCROLL, ADDR. Unset upon STATUS read
     latch = false;
 
-    buildMetatileData();
-    buildTileData();
-    buildPixelData();
-    buildSpriteData();
-
+    masterClock = 0;
     clockCounter = VBLANK;
+    renderCycle = VBLANK;
     frameCounter = 0;
     oddFrame = false;
     spr0Latch = false;
-    spr0Reload = false;
+    spr0OnLine = false;
+    reusingFrame = false;
+    frameReusable = false;
 }
 
 void PPU::setCTRL(uint8_t value)
 {
-    nameTableAddr = value & 0x03;
+    uint32_t registers = getFrameRegisters();
+    tempVRamAddr = (tempVRamAddr & ~LOOPY_NAME_TABLE) | ((value & 0x03) << 10);
     vRamAddrIncr = !!(value & 0x04);
     sprPatternTableSelector = !!(value & 0x08);
     bgPatternTableSelector = !!(value & 0x10);
     bigSprites = !!(value & 0x20);
     nmiOnVBlank = !!(value & 0x80);
+    registersWritten(registers);
 }
 
 void PPU::setMASK(uint8_t value)
 {
+    if (grayscale != !!(value & 0x01) ||
+	buffRed != !!(value & 0x20) ||
+	buffGreen != !!(value & 0x40) ||
+	buffBlue != !!(value & 0x80)) {
+	coloursDirty = true;
+    }
+    uint32_t registers = getFrameRegisters();
     grayscale = !!(value & 0x01);
     imageMask = !!(value & 0x02);
     sprMask = !!(value & 0x04);
@@ -84,6 +103,7 @@ void PPU::setMASK(uint8_t value)
     buffRed = !!(value & 0x20);
     buffGreen = !!(value & 0x40);
     buffBlue = !!(value & 0x80);
+    registersWritten(registers);
 }
 
 uint8_t PPU::getSTATUS()
@@ -115,10 +135,39 @@ void PPU::setOAMDATA(uint8_t value)
     if ((oamAddrBuffer & 0x3) == 2) {
         value &= 0xE3;
     }
+    if (oam[oamAddrBuffer] != value) {
+	videoStateChanged();
+    }
     oam[oamAddrBuffer] = value;
     oamAddrBuffer++;
 }
 
+void PPU::writeOAMPage(const uint8_t *page)
+{
+    copyOAMPage(page);
+}
+
+uint64_t PPU::copyOAMPage(const uint8_t *page)
+{
+    uint64_t changed = 0;
+    uint8_t addr = oamAddrBuffer;
+    for (int i = 0; i < 0x100; ++i, ++addr) {
+	uint8_t value = page[i];
+	if ((addr & 0x3) == 2) {
+	    value &= 0xE3;
+	}
+	if (oam[addr] != value) {
+	    changed |= (uint64_t)1 << (addr >> 2);
+	    oam[addr] = value;
+	}
+    }
+    // 256 writes leave OAMADDR where it started
+    if (changed) {
+	videoStateChanged();
+    }
+    return changed;
+}
+
 uint8_t PPU::getOAMDATA()
 {
     // apparently unreliable in NES hardware, but some games use it
@@ -127,181 +176,259 @@ uint8_t PPU::getOAMDATA()
 
 void PPU::setSCROLL(uint8_t value)
 {
+    uint32_t registers = getFrameRegisters();
     if (!latch) {
-        scrollX = value;
+	tempVRamAddr = (tempVRamAddr & ~LOOPY_COARSE_X) | (value >> 3);
+	fineXScroll = value & 0x07;
     } else {
-        scrollY = value;
+	tempVRamAddr = (tempVRamAddr & ~(LOOPY_COARSE_Y | LOOPY_FINE_Y)) |
+	    ((value & 0xF8) << 2) | ((value & 0x07) << 12);
     }
     latch = !latch;
+    registersWritten(registers);
 }
 
 void PPU::setADDR(uint8_t value)
 {
+    uint32_t registers = getFrameRegisters();
     if (!latch) {
-        // set high byte
-        addrBuffer &= 0x00FF;
-        addrBuffer |= ((uint16_t)value << 8);
+        // set high byte, the top bit of which is lost
+	tempVRamAddr = (tempVRamAddr & 0x00FF) | ((value & 0x3F) << 8);
     } else {
-        // set low byte
-        addrBuffer &= 0xFF00;
-        addrBuffer |= value;
-	// set scroll and nametable selector values
-	scrollX &= 0x07; // clear coarse x scroll bits
-	scrollX |= (addrBuffer << 3) & 0xFF; // add new coarse x scroll bits
-	scrollY = 0x0; // clear all y scroll bits
-	scrollY |= (addrBuffer >> 2) & 0xF8; // add new coarse y scroll bits
-	scrollY |= (addrBuffer >> 12) & 0x07; // add new fine y scroll bits
-	nameTableAddr = (addrBuffer >> 10) & 0x03; // add new nametable select bits
+        // set low byte, after which the address takes effect
+	tempVRamAddr = (tempVRamAddr & 0xFF00) | value;
+	vRamAddr = tempVRamAddr;
+	if (isDrawing()) {
+	    videoStateChanged();
+	}
     }
     latch = !latch;
+    registersWritten(registers);
 }
 
 void PPU::setDATA(uint8_t value)
 {
-    write(addrBuffer, value);
-    addrBuffer += ((vRamAddrIncr) ? 32 : 1);
+    write(vRamAddr, value);
+    vRamAddr = (vRamAddr + ((vRamAddrIncr) ? 32 : 1)) & 0x7FFF;
+    if (isDrawing()) {
+	videoStateChanged();
+    }
 }
 
 uint8_t PPU::getDATA()
 {
+    uint16_t addr = vRamAddr & 0x3FFF;
     uint8_t returnVal;
-    if (addrBuffer < 0x3F00) {
+    if (addr < 0x3F00) {
         // return what's in the read buffer from the previous
         // read, then load data at current address buffer
         // (before incrementing the address) into the read buffer
         returnVal = readBuffer;
-        readBuffer = read(addrBuffer);
+        readBuffer = read(addr);
     } else {
         // when the address buffer points to the palette address range,
         // instead of reading from the read buffer, it returns the
         // data at the immediate address, and stores the name table
         // data that would otherwise be mirrored "underneath" the
         // palette address space in the read buffer
-        returnVal = read(addrBuffer);
-        readBuffer = read(addrBuffer - 0x1000);
+        returnVal = read(addr);
+        readBuffer = read(addr - 0x1000);
+    }
+    vRamAddr = (vRamAddr + ((vRamAddrIncr) ? 32 : 1)) & 0x7FFF;
+    if (isDrawing()) {
+	videoStateChanged();
     }
-    addrBuffer += ((vRamAddrIncr) ? 32 : 1);
     return returnVal;
 }
 
-void PPU::reloadGraphicsData()
-{
-    reloadTileData();
-    reloadMetatileData();
-    reloadSpriteData();
-}
-
-void PPU::renderPixel(int x, int y)
-{
-    int realX = x;
-    if (nameTableAddr & 0b01) {
-        realX += 256;
-    }
-    realX += scrollX;
-    realX &= (512 - 1);
-
-    int realY = y;
-    if (nameTableAddr & 0b10) {
-        realY += 240;
-    }
-    realY += scrollY;
-    realY %= 480;
-
-    if (sprites[0].occludes(x, y) &&
-	((sprites[0].getValue(x, y, bigSprites) & 0x3) != 0) &&
-	((bgPixels[realX][realY].getValue() & 0x3) != 0) &&
-	((x > 7) || (imageMask && sprMask)) &&
-	x != 255 &&
-	!spr0Latch &&
-	showBg &&
-	showSpr) {
-	spr0Hit = true;
-	spr0Latch = true;
-	spr0Reload = true;
-    }
-
-    // render first occluding sprite that isn't transparent
-    bool isBgSpr = false;
-    if (showSpr && (x > 7 || sprMask)) {
-        int spriteBufferSize = spriteBuffer.size();
-	for (int i = 0; i < spriteBufferSize; ++i) {
-	    if (spriteBuffer[i].occludes(x, y)) {
-		uint8_t paletteIndex = spriteBuffer[i].getValue(x, y, bigSprites);
-		if ((paletteIndex & 0x3) != 0) {
-		    uint8_t paletteVal = readPalette(paletteIndex);
-		    uint32_t pixelColour = universalPalette[paletteVal];
-		    frameBuffer[x + (y * FRAME_WIDTH)] = pixelColour;
-		    isBgSpr = spriteBuffer[i].priority;
-		    if (!isBgSpr) {
-			return;
-		    } else {
-			break;
-		    }
-		}
-	    }
-	}
-    }
+bool PPU::isStatusStable()
+{
+    // sprite 0 can only hit while it's on the line being drawn, and
+    // overflow is only set by evaluating sprites at dot 257
+    int dot = clockCounter % CYC_PER_SCANL;
+    bool spr0Done = spr0Latch || !spr0OnLine;
+    bool overflowDone = sprOverflow || (!showBg && !showSpr);
+    return clockCounter >= POST_REND || dot > 257 || (spr0Done && overflowDone);
+}
 
-    // otherwise render background if not transparent
-    if (showBg && (x > 7 || imageMask)) {
-	uint8_t paletteIndex = bgPixels[realX][realY].getValue();
-	if ((paletteIndex & 0x3) != 0) {
-	    uint8_t paletteVal = readPalette(paletteIndex);
-	    uint32_t pixelColour = universalPalette[paletteVal];
-	    frameBuffer[x + (y * FRAME_WIDTH)] = pixelColour;
-	    return;
-	}
+void PPU::videoStateChanged()
+{
+    ++videoGeneration;
+    // lines already run were the same as the last frame's, the rest won't be
+    reusingFrame = false;
+}
+
+// the registers a frame is drawn from, other than v, which is reloaded
+// from t before it
+uint32_t PPU::getFrameRegisters()
+{
+    return tempVRamAddr | (fineXScroll << 15) |
+	(sprPatternTableSelector << 18) | (bgPatternTableSelector << 19) |
+	(bigSprites << 20) | (grayscale << 21) | (imageMask << 22) |
+	(sprMask << 23) | (showBg << 24) | (showSpr << 25) |
+	(buffRed << 26) | (buffGreen << 27) | (buffBlue << 28);
+}
+
+void PPU::registersWritten(uint32_t registers)
+{
+    if (getFrameRegisters() != registers && isDrawing()) {
+	videoStateChanged();
     }
+}
+
+bool PPU::isDrawing()
+{
+    return clockCounter < POST_REND || clockCounter >= PRE_REND;
+}
 
-    // otherwise render universal background colour
-    if (!isBgSpr) {
-	frameBuffer[x + (y * FRAME_WIDTH)] = universalPalette[readPalette(0)];
+void PPU::incrementX()
+{
+    if ((vRamAddr & LOOPY_COARSE_X) == 31) {
+	// wrap into the horizontally adjacent name table
+	vRamAddr &= ~LOOPY_COARSE_X;
+	vRamAddr ^= 0x0400;
+    } else {
+	++vRamAddr;
     }
 }
 
-void PPU::renderFrame()
+void PPU::incrementY()
 {
-    for (int y = 0; y < FRAME_HEIGHT; y++) {
-        for (int x = 0; x < FRAME_WIDTH; x++) {
-            renderPixel(x, y);
-        }
+    if ((vRamAddr & LOOPY_FINE_Y) != LOOPY_FINE_Y) {
+	vRamAddr += 0x1000;
+	return;
     }
+    vRamAddr &= ~LOOPY_FINE_Y;
+    int coarseY = (vRamAddr & LOOPY_COARSE_Y) >> 5;
+    if (coarseY == 29) {
+	// wrap into the vertically adjacent name table
+	coarseY = 0;
+	vRamAddr ^= 0x0800;
+    } else if (coarseY == 31) {
+	// rows 30 and 31 are attributes, and wrap without switching
+	coarseY = 0;
+    } else {
+	++coarseY;
+    }
+    vRamAddr = (vRamAddr & ~LOOPY_COARSE_Y) | (coarseY << 5);
 }
 
-void PPU::renderScanline(int scanlNum)
+void PPU::outputLine(int scanlNum, const uint8_t *line)
 {
-    for (int x = 0; x < FRAME_WIDTH; x++) {
-	renderPixel(x, scanlNum);
+    if (renderSkipped || reusingFrame) {
+	return;
+    }
+    if (coloursDirty) {
+	resolveColours();
+    }
+    if (indexedOutput) {
+	uint16_t *pixel = &indexedFrameBuffer[scanlNum * FRAME_WIDTH];
+	for (int x = 0; x < FRAME_WIDTH; x++) {
+	    pixel[x] = colourIndices[line[x]];
+	}
+	staleLines[scanlNum] = true;
+	frameBufferStale = true;
+    } else {
+	uint32_t *pixel = &frameBuffer[scanlNum * FRAME_WIDTH];
+	for (int x = 0; x < FRAME_WIDTH; x++) {
+	    pixel[x] = colours[line[x]];
+	}
     }
 }
 
 uint32_t *PPU::getFrameBuffer()
 {
+    if (frameBufferStale) {
+	for (unsigned int y = 0; y < FRAME_HEIGHT; ++y) {
+	    if (staleLines[y]) {
+		compositor.expand(&indexedFrameBuffer[y * FRAME_WIDTH],
+				  &frameBuffer[y * FRAME_WIDTH], FRAME_WIDTH);
+		staleLines[y] = false;
+	    }
+	}
+	frameBufferStale = false;
+    }
     return frameBuffer;
 }
 
-void PPU::tick()
+void PPU::setIndexedOutput(bool indexed)
+{
+    // catch up on any indexed lines first
+    getFrameBuffer();
+    indexedOutput = indexed;
+    // the other buffer's frame may be older
+    frameReusable = false;
+}
+
+const uint16_t *PPU::getIndexedFrameBuffer()
+{
+    return indexedFrameBuffer;
+}
+
+void PPU::runUntil(uint64_t time)
+{
+    while (masterClock < time) {
+	uint64_t cyclesToEvent = getNextEventCycle() - clockCounter;
+	if (cyclesToEvent > time - masterClock) {
+	    clockCounter += time - masterClock;
+	    masterClock = time;
+	    break;
+	}
+	clockCounter += cyclesToEvent;
+	masterClock += cyclesToEvent;
+	handleEvent();
+    }
+    renderUntil(clockCounter);
+}
+
+uint64_t PPU::getNextEventTime()
+{
+    return masterClock + (getNextEventCycle() - clockCounter);
+}
+
+int PPU::getNextEventCycle()
+{
+    if (clockCounter < POST_REND - CYC_PER_SCANL) {
+	// start of the next rendered scanline
+	return (clockCounter / CYC_PER_SCANL + 1) * CYC_PER_SCANL;
+    } else if (clockCounter < VBLANK) {
+	return VBLANK;
+    } else if (clockCounter < PRE_REND) {
+	return PRE_REND;
+    } else {
+	return CYC_PER_FRAME;
+    }
+}
+
+void PPU::handleEvent()
 {
-    ++clockCounter;
+    renderUntil(clockCounter);
     if (clockCounter >= POST_REND) {
 	switch (clockCounter) {
 	case CYC_PER_FRAME:
 	    isVBlank = false;
 	    clockCounter = 0;
-	    reloadGraphicsData();
 	    if (oddFrame && (showBg || showSpr)) {
 		// skip idle cycle 0
 		++clockCounter;
-		renderScanline(0);
 	    }
+	    renderCycle = clockCounter;
 	    break;
-	case PRE_REND:
+	case PRE_REND: {
 	    isVBlank = false;
 	    spr0Hit = false;
+	    sprOverflow = false;
 	    spr0Latch = false;
-	    spr0Reload = false;
-	    break;
+	    uint32_t registers = getFrameRegisters();
+	    reusingFrame = !renderSkipped && frameReusable &&
+		videoGeneration == frameGeneration && registers == frameRegisters;
+	    frameGeneration = videoGeneration;
+	    frameRegisters = registers;
+	} break;
 	case VBLANK:
+	    frameUpdated = !renderSkipped && !reusingFrame;
+	    frameReusable = !renderSkipped && videoGeneration == frameGeneration;
+	    reusingFrame = false;
 	    isVBlank = true;
 	    if (nmiOnVBlank) {
 		nmi();
@@ -310,27 +437,8 @@ void PPU::tick()
 	    oddFrame ^= 1;
 	    break;
 	}
-    } else if (!(clockCounter % CYC_PER_SCANL)) {
-	if (spr0Reload) {
-	    reloadGraphicsData();
-	    spr0Reload = false;
-	}
+    } else {
 	oamAddrBuffer = 0;
-        reloadSpriteBuffer();
-        renderScanline(clockCounter / CYC_PER_SCANL);
-    }
-}
-
-void PPU::reloadSpriteBuffer()
-{
-    int currentScanl = clockCounter / CYC_PER_SCANL;
-    spriteBuffer.clear();
-    for (int i = 0; i < 64; ++i) {
-        if (sprites[i].visible &&
-            sprites[i].yPos <= currentScanl &&
-            sprites[i].yBound > currentScanl) {
-            spriteBuffer.push_back(sprites[i]);
-        }
     }
 }
 
@@ -371,8 +479,25 @@ uint8_t PPU::readPalette(uint16_t index)
     return paletteRam[index];
 }
 
+void PPU::resolveColours()
+{
+    int emphasis = (buffRed ? 0b001 : 0) | (buffGreen ? 0b010 : 0) | (buffBlue ? 0b100 : 0);
+    uint8_t colourMask = grayscale ? 0x30 : 0x3F;
+    for (int i = 0; i < 0x20; ++i) {
+	colourIndices[i] = (emphasis << 6) | (readPalette(i) & colourMask);
+	colours[i] = emphasisPalette[colourIndices[i]];
+    }
+    coloursDirty = false;
+}
+
 void PPU::writePalette(uint16_t index, uint8_t value)
 {
+    // palette ram is only 6 bits wide
+    value &= 0x3F;
+    if (paletteRam[index] != value) {
+	videoStateChanged();
+    }
+    coloursDirty = true;
     paletteRam[index] = value;
     if ((index & 0x3) == 0) {
 	paletteRam[index ^ 0x10] = value;
@@ -381,184 +506,26 @@ void PPU::writePalette(uint16_t index, uint8_t value)
 
 uint8_t PPU::readNameTables(uint16_t index)
 {
-    uint16_t mirroredIndex = getCiRamIndexFromNameTableIndex(index);
-    return ciRam[mirroredIndex];
+    return nameTableMap->read(index);
 }
 
 void PPU::writeNameTables(uint16_t index, uint8_t value)
 {
-    uint16_t mirroredIndex = getCiRamIndexFromNameTableIndex(index);
-    ciRam[mirroredIndex] = value;
-}
-
-uint16_t PPU::getCiRamIndexFromNameTableIndex(uint16_t index)
-{
-    switch (cart->getMirroring()) {
-    case MIRROR_VERTICAL:
-	return index & 0x07FF;
-    case MIRROR_HORIZONTAL:
-	if (index & 0x800) {
-	    index |= 0x400;
-	}
-	return index & 0x07FF;
-    case MIRROR_LOWER_BANK:
-	return index & 0xF3FF;
-    case MIRROR_UPPER_BANK:
-	return (index & 0xF3FF) + 0x400;
+    if (nameTableMap->read(index) != value) {
+	videoStateChanged();
     }
-    assert(!"Invalid code path");
-    return 0;
+    nameTableMap->write(index, value);
 }
 
 uint8_t PPU::readPatternTables(uint16_t index)
 {
-    return cart->readChr(index);
+    return chrMap->read(index);
 }
 
 void PPU::writePatternTables(uint16_t index, uint8_t value)
 {
-    cart->writeChr(index, value);
-}
-
-void PPU::buildMetatileData()
-{
-    for (int nt = 0; nt < 4; ++nt) {
-        for (int x = 0; x < 8; ++x) {
-            for (int y = 0; y < 8; ++y) {
-                // index in nametable where attribute data is located
-                uint16_t nameTableIndex = 0x3C0 + (0x400 * nt) + (y * 8) + x;
-                bgMetaTiles[nt][x][y].nameTableIndex = nameTableIndex;
-            }
-        }
-    }
-}
-
-void PPU::reloadMetatileData()
-{
-    for (int nt = 0; nt < 4; ++nt) {
-	for (int x = 0; x < 8; ++x) {
-            for (int y = 0; y < 8; ++y) {
-                bgMetaTiles[nt][x][y].attributeByte =
-		    readNameTables(bgMetaTiles[nt][x][y].nameTableIndex);
-            }
-        }
-    }
-}
-
-void PPU::buildTileData()
-{
-    for (int nt = 0; nt < 4; ++nt) {
-        for (int x = 0; x < 32; ++x) {
-            for (int y = 0; y < 30; ++y) {
-                // offset in name table where data is located
-                uint16_t nameTableIndex = (0x400 * nt) + x + (y * 32);
-                // position within enclosing metatile
-                uint8_t quadrant = 0;
-                if ((x & 0x3) >= 2) {
-                    quadrant |= 0b01;
-                }
-                if ((y & 0x3) >= 2) {
-                    quadrant |= 0b10;
-                }
-                // coordinates of parent metatile
-                uint8_t mtX = x / 4;
-                uint8_t mtY = y / 4;
-		bgTiles[nt][x][y].metaTile = &bgMetaTiles[nt][mtX][mtY];
-		bgTiles[nt][x][y].quadrant = quadrant;
-		bgTiles[nt][x][y].nameTableIndex = nameTableIndex;
-            }
-        }
-    }
-}
-
-void PPU::reloadTileData()
-{
-    for (int nt = 0; nt < 4; ++nt) {
-        for (int x = 0; x < 32; ++x) {
-            for (int y = 0; y < 30; ++y) {
-		int patternTableIndex =
-		    readNameTables(bgTiles[nt][x][y].nameTableIndex) * 16;
-		if (bgPatternTableSelector) {
-		    patternTableIndex += 0x1000;
-		}
-		for (int i = 0; i < 16; ++i) {
-		    bgTiles[nt][x][y].pattern[i] =
-			readPatternTables(patternTableIndex + i);
-		}
-            }
-        }
-    }
-}
-
-void PPU::buildPixelData()
-{
-    for (int x = 0; x < 512; ++x) {
-        for (int y = 0; y < 480; ++y) {
-            // find tile to which pixel belongs
-            int nt = 0;
-            if (x >= 256) {
-                nt += 0b01;
-            }
-            if (y >= 240) {
-                nt += 0b10;
-            }
-            int tileX = (x & (256 - 1)) / 8;
-            int tileY = (y % 240) / 8;
-            // init
-	    bgPixels[x][y].tile = &bgTiles[nt][tileX][tileY];
-	    bgPixels[x][y].x = (x & 0x7);
-	    bgPixels[x][y].y = (y & 0x7);
-        }
-    }
-}
-
-void PPU::buildSpriteData()
-{
-    for (int i = 0; i < 64; i++) {
-	sprites[i].oamIndex = i * 4;
-    }
-}
-
-void PPU::reloadSpriteData()
-{
-    for (int i = 0; i < 64; ++i) {
-	sprites[i].xPos = oam[sprites[i].oamIndex + 3];
-	sprites[i].yPos = oam[sprites[i].oamIndex];
-	sprites[i].visible =
-	    (sprites[i].xPos < 0xF9) && (sprites[i].yPos < 0xEF);
-
-	sprites[i].yPos++;
-	sprites[i].xBound = (int)(sprites[i].xPos) + 8;
-	sprites[i].yBound = (int)(sprites[i].yPos) + (bigSprites ? 16 : 8);
-
-	if (!sprites[i].visible) {
-	    continue;
-	}
-
-	int patternTableIndex = 0;
-	if (bigSprites) {
-	    // 8x16 sprite
-	    patternTableIndex = (oam[sprites[i].oamIndex + 1] & 0b11111110) * 16;
-	    if (oam[sprites[i].oamIndex + 1] & 0b00000001) {
-		patternTableIndex += 0x1000;
-	    }
-	} else {
-	    // 8x8 sprite
-	    patternTableIndex = oam[sprites[i].oamIndex + 1] * 16;
-	    if (sprPatternTableSelector) {
-		// stuff
-		patternTableIndex += 0x1000;
-	    }
-	}
-	for (int patternOffset = 0; patternOffset < (bigSprites ? 32 : 16); ++patternOffset) {
-	    sprites[i].pattern[patternOffset] =
-		readPatternTables(patternTableIndex + patternOffset);
-	}
-
-	sprites[i].paletteSelect =
-	    ((oam[sprites[i].oamIndex + 2] & 0b00000011) << 2) | 0x10;
-	sprites[i].priority = !!(oam[sprites[i].oamIndex + 2] & 0b00100000);
-	sprites[i].flipHor  = !!(oam[sprites[i].oamIndex + 2] & 0b01000000);
-	sprites[i].flipVert = !!(oam[sprites[i].oamIndex + 2] & 0b10000000);
+    if (readPatternTables(index) != value) {
+	videoStateChanged();
     }
+    cart->writeChr(index, value);
 }
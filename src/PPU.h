@@ -2,11 +2,41 @@
 #define PPU_H
 
 #include <cstdint>
-#include <vector>
 
 #include <CPU.h>
 #include <Cart.h>
-#include <Graphics.h>
+#include <ChrMap.h>
+#include <Compositor.h>
+#include <NameTableMap.h>
+#include <Palette.h>
+
+/*
+ * Notes:
+ *
+ * - Scrolling follows the hardware's internal registers, as described by
+ * loopy: v is the current vram address, also used as the scroll position
+ * while rendering, t the address or scroll to be copied into it, and x the
+ * fine x scroll.
+ *
+ * - Rather than a dot at a time, the ppu is run in spans. Before any
+ * register access the Console syncs it up to the current cpu cycle, which
+ * draws every dot up to there with the registers as they were, so writes
+ * made mid line take effect from the dot they're made on.
+ *
+ * - Registers, memory, timing and frame output are shared here, and how
+ * the dots are drawn is left to a backend (see ppus/). ScanlinePPU draws
+ * lines in runs of pixels, and DotPPU steps the hardware's fetches and
+ * shift registers a dot at a time, for comparing against and for the
+ * games that need it.
+ *
+ * - Anything a frame is drawn from bumps videoGeneration when it changes:
+ * vram, chr, oam, palette, chr banks and mirroring, as well as CTRL, MASK,
+ * t, x and v while a frame is being drawn. Register writes between frames
+ * only matter if they leave the registers different by the next one. A
+ * frame that starts with everything as it was for the last, which was
+ * drawn without any changes, is run without being output, keeping the
+ * last one, until something changes.
+ */
 
 static const unsigned int FRAME_WIDTH = 256;
 static const unsigned int FRAME_HEIGHT = 240;
@@ -18,82 +48,88 @@ static const int CYC_PER_FRAME    = CYC_PER_SCANL * SCANL_PER_FRAME;
 static const int POST_REND        = CYC_PER_SCANL * 240;
 static const int VBLANK           = CYC_PER_SCANL * 241;
 static const int PRE_REND         = CYC_PER_SCANL * 261;
+static const int SPR_PER_SCANL    = 8;
+
+// fields of v and t, laid out as yyy NN YYYYY XXXXX
+static const uint16_t LOOPY_COARSE_X   = 0x001F;
+static const uint16_t LOOPY_COARSE_Y   = 0x03E0;
+static const uint16_t LOOPY_NAME_TABLE = 0x0C00;
+static const uint16_t LOOPY_FINE_Y     = 0x7000;
+// the bits copied from t to v at the end of each line and frame
+static const uint16_t LOOPY_HORIZONTAL = LOOPY_COARSE_X | 0x0400;
+static const uint16_t LOOPY_VERTICAL   = LOOPY_COARSE_Y | 0x0800 | LOOPY_FINE_Y;
 
 using NMI = std::function<void()>;
 
-static const uint32_t universalPalette[64] = {
-    0x757575, 0x271B8F, 0x0000AB, 0x47009F, 0x8F0077, 0xAB0013,
-    0xA70000, 0x7F0B00, 0x432F00, 0x004700, 0x005100, 0x003F17,
-    0x1B3F5F, 0x000000, 0x000000, 0x000000, 0xBCBCBC, 0x0073EF,
-    0x233BEF, 0x8300F3, 0xBF00BF, 0xE7005B, 0xDB2B00, 0xCB4F0F,
-    0x8B7300, 0x009700, 0x00AB00, 0x00933B, 0x00838B, 0x000000,
-    0x000000, 0x000000, 0xFFFFFF, 0x3FBFFF, 0x5F97FF, 0xA78BFD,
-    0xF77BFF, 0xFF77B7, 0xFF7763, 0xFF9B3B, 0xF3BF3F, 0x83D313,
-    0x4FDF4B, 0x58F898, 0x00EBDB, 0x444444, 0x000000, 0x000000,
-    0xFFFFFF, 0xABE7FF, 0xC7D7FF, 0xD7CBFF, 0xFFC7FF, 0xFFC7DB,
-    0xFFBFB3, 0xFFDBAB, 0xFFE7A3, 0xE3FFA3, 0xABF3BF, 0xB3FFCF,
-    0x9FFFF3, 0xAAAAAA, 0x000000, 0x000000 };
+enum PpuBackend
+{
+    PPU_BACKEND_SCANLINE,
+    PPU_BACKEND_DOT,
+};
 
 class PPU
 {
 public:
-    PPU(Cart *cart, NMI nmi);
-    void reset();
-    void setCTRL(uint8_t value);
+    PPU(Cart *cart, ChrMap *chrMap, NameTableMap *nameTableMap, NMI nmi);
+    virtual ~PPU() { }
+    virtual void reset();
+    virtual void setCTRL(uint8_t value);
     void setMASK(uint8_t value);
     uint8_t getSTATUS();
     void setOAMADDR(uint8_t value);
-    void setOAMDATA(uint8_t value);
+    virtual void setOAMDATA(uint8_t value);
     uint8_t getOAMDATA();
+    // a whole page written through OAMDATA, as by DMA
+    virtual void writeOAMPage(const uint8_t *page);
     void setSCROLL(uint8_t value);
     void setADDR(uint8_t value);
     void setDATA(uint8_t value);
     uint8_t getDATA();
-    void tick();
+    // catch up to the given master clock time, inclusive
+    void runUntil(uint64_t time);
+    uint64_t getNextEventTime();
     uint32_t *getFrameBuffer();
+    // frames kept as indices into emphasisPalette instead, only turned
+    // into colours when getFrameBuffer() is called. Lines not yet drawn
+    // since switching are left as they were.
+    void setIndexedOutput(bool indexed);
+    bool getIndexedOutput() { return indexedOutput; }
+    const uint16_t *getIndexedFrameBuffer();
+    // lines are still run for their timing, sprite 0 hits and overflow,
+    // but not coloured into the frame, which is left as it was
+    void setRenderSkipped(bool skipped) { renderSkipped = skipped; }
+    // whether the last frame was drawn with anything new, rather than
+    // skipped or left as the one before it
+    bool frameChanged() { return frameUpdated; }
+    // for changes the ppu can't see itself, to chr banks and mirroring
+    void videoStateChanged();
     bool endOfFrame();
+    // whether STATUS can't change before the next event
+    bool isStatusStable();
+    virtual const char *getName() = 0;
 
-private:
-    uint8_t read(uint16_t addr);
-    void write(uint16_t addr, uint8_t value);
-    void reloadGraphicsData();
-    void renderFrame();
-    void renderPixel(int x, int y);
-    void renderScanline(int scanlNum);
-    uint8_t readPalette(uint16_t index);
-    void writePalette(uint16_t index, uint8_t value);
+protected:
+    // draw every dot before cycle
+    virtual void renderUntil(int cycle) = 0;
+    virtual void writePatternTables(uint16_t addr, uint8_t value);
+    void incrementX();
+    void incrementY();
+    // colours a line of palette indices into the frame
+    void outputLine(int scanlNum, const uint8_t *line);
     uint8_t readNameTables(uint16_t addr);
-    void writeNameTables(uint16_t addr, uint8_t value);
     uint8_t readPatternTables(uint16_t addr);
-    void writePatternTables(uint16_t addr, uint8_t value);
-    uint16_t getCiRamIndexFromNameTableIndex(uint16_t index);
-    void buildMetatileData();
-    void reloadMetatileData();
-    void buildTileData();
-    void reloadTileData();
-    void buildPixelData();
-    void buildSpriteData();
-    void reloadSpriteData();
-    void reloadSpriteBuffer();
+    // returns the sprites changed, a bit each
+    uint64_t copyOAMPage(const uint8_t *page);
 
     Cart *cart;
-    NMI nmi;
+    ChrMap *chrMap;
+    NameTableMap *nameTableMap;
 
-    // memory
     uint8_t oam[0x100] = {0};
-    uint8_t ciRam[0x800] = {0};
-    uint8_t paletteRam[0x20] = {
-	0x09, 0x01, 0x00, 0x01, 0x00, 0x02, 0x02, 0x0D,
-	0x08, 0x10, 0x08, 0x24, 0x00, 0x00, 0x04, 0x2C,
-	0x09, 0x01, 0x34, 0x03, 0x00, 0x04, 0x00, 0x14,
-	0x08, 0x3A, 0x00, 0x02, 0x00, 0x20, 0x2C, 0x08};
 
     // REGISTERS
 
-    // latch used for SCROLL, ADDR. Unset upon STATUS read
-    bool latch;
     // 0x2000: CTRL
-    int nameTableAddr;          // 0=0x2000, 1=0x2400, 2=0x2800, 3=0x2C00
     bool vRamAddrIncr;          // 0=1 (across name table), 1=32 (down name table)
     bool sprPatternTableSelector;// 0=0x0000, 1=0x1000, ignored if sprSize is 8x16
     bool bgPatternTableSelector;// 0=0x0000, 1=0x1000
@@ -114,26 +150,73 @@ private:
     bool isVBlank;              // set during VBlank
     // 0x2003: OAMADDR
     uint8_t oamAddrBuffer;
-    // 0x2005: SCROLL
-    uint8_t scrollX;
-    uint8_t scrollY;
-    // 0x2006: ADDR
-    uint16_t addrBuffer;
+    // 0x2005: SCROLL, 0x2006: ADDR
+    uint16_t vRamAddr;          // v
+    uint16_t tempVRamAddr;      // t, CTRL also sets its name table bits
+    uint8_t fineXScroll;        // x
+
+    int clockCounter;
+    // dots before this have been drawn
+    int renderCycle;
+    bool spr0Latch;
+    // whether sprite 0 is on the line being drawn, kept by the backend
+    bool spr0OnLine;
+    bool renderSkipped;
+    // the frame being drawn is the same as the last, so isn't output
+    bool reusingFrame;
+
+    Compositor compositor;
+
+private:
+    int getNextEventCycle();
+    uint32_t getFrameRegisters();
+    void registersWritten(uint32_t registers);
+    bool isDrawing();
+    void handleEvent();
+    uint8_t read(uint16_t addr);
+    void write(uint16_t addr, uint8_t value);
+    uint8_t readPalette(uint16_t index);
+    void resolveColours();
+    void writePalette(uint16_t index, uint8_t value);
+    void writeNameTables(uint16_t addr, uint8_t value);
+
+    NMI nmi;
+
+    // memory
+    uint8_t paletteRam[0x20] = {
+	0x09, 0x01, 0x00, 0x01, 0x00, 0x02, 0x02, 0x0D,
+	0x08, 0x10, 0x08, 0x24, 0x00, 0x00, 0x04, 0x2C,
+	0x09, 0x01, 0x34, 0x03, 0x00, 0x04, 0x00, 0x14,
+	0x08, 0x3A, 0x00, 0x02, 0x00, 0x20, 0x2C, 0x08};
+
+    // latch used for SCROLL, ADDR. Unset upon STATUS read
+    bool latch;
     // 0x2007: DATA
     uint8_t readBuffer;
 
-    int clockCounter;
+    uint64_t masterClock;
     int frameCounter;
     bool oddFrame;
-    bool spr0Latch;
-    bool spr0Reload;
 
     uint32_t frameBuffer[FRAME_WIDTH * FRAME_HEIGHT];
-    Pixel bgPixels[512][480];
-    Tile bgTiles[4][32][30];
-    Metatile bgMetaTiles[4][8][8];
-    Sprite sprites[64];
-    std::vector<Sprite> spriteBuffer;
+    uint16_t indexedFrameBuffer[FRAME_WIDTH * FRAME_HEIGHT];
+    bool indexedOutput;
+    // lines of frameBuffer that are behind indexedFrameBuffer
+    bool staleLines[FRAME_HEIGHT];
+    bool frameBufferStale;
+    // the colour of each palette entry, with emphasis and grayscale
+    // applied, rebuilt when either or palette ram changes
+    uint32_t colours[0x20];
+    uint16_t colourIndices[0x20];
+    bool coloursDirty;
+
+    uint32_t videoGeneration;
+    // the generation and registers of the last frame, and whether it was
+    // drawn with them throughout
+    uint32_t frameGeneration;
+    uint32_t frameRegisters;
+    bool frameReusable;
+    bool frameUpdated;
 };
 
 #endif
@@ -0,0 +1,69 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <cstdint>
+
+/*
+ * Notes:
+ *
+ * - Palette ram holds 6 bit indices into the 64 colours the NES can
+ * output. The 3 emphasis bits of PPUMASK then darken the colour
+ * channels other than the ones emphasised, so every colour the ppu can put out
+ * is one of 512 (64 colours x 8 emphasis settings). They are all
+ * worked out at compile time, indexed by emphasis << 6 | colour.
+ *
+ * - Grayscale keeps only the column of grays (the top 2 bits of the
+ * colour), and is applied to the index before looking it up.
+ */
+
+constexpr uint32_t universalPalette[64] = {
+    0x757575, 0x271B8F, 0x0000AB, 0x47009F, 0x8F0077, 0xAB0013,
+    0xA70000, 0x7F0B00, 0x432F00, 0x004700, 0x005100, 0x003F17,
+    0x1B3F5F, 0x000000, 0x000000, 0x000000, 0xBCBCBC, 0x0073EF,
+    0x233BEF, 0x8300F3, 0xBF00BF, 0xE7005B, 0xDB2B00, 0xCB4F0F,
+    0x8B7300, 0x009700, 0x00AB00, 0x00933B, 0x00838B, 0x000000,
+    0x000000, 0x000000, 0xFFFFFF, 0x3FBFFF, 0x5F97FF, 0xA78BFD,
+    0xF77BFF, 0xFF77B7, 0xFF7763, 0xFF9B3B, 0xF3BF3F, 0x83D313,
+    0x4FDF4B, 0x58F898, 0x00EBDB, 0x444444, 0x000000, 0x000000,
+    0xFFFFFF, 0xABE7FF, 0xC7D7FF, 0xD7CBFF, 0xFFC7FF, 0xFFC7DB,
+    0xFFBFB3, 0xFFDBAB, 0xFFE7A3, 0xE3FFA3, 0xABF3BF, 0xB3FFCF,
+    0x9FFFF3, 0xAAAAAA, 0x000000, 0x000000 };
+
+// each emphasis bit dims the other two channels to about 0.82 (13/16)
+constexpr uint32_t dimLevel(uint32_t level, int times)
+{
+    return times ? dimLevel(level * 13 / 16, times - 1) : level;
+}
+
+constexpr uint32_t dimChannel(uint32_t colour, int shift, int times)
+{
+    return dimLevel((colour >> shift) & 0xFF, times) << shift;
+}
+
+// emphasis is PPUMASK's bits 5-7: red, green and blue
+constexpr uint32_t emphasise(uint32_t colour, int emphasis)
+{
+    return dimChannel(colour, 16, !!(emphasis & 0b010) + !!(emphasis & 0b100)) |
+	   dimChannel(colour, 8, !!(emphasis & 0b001) + !!(emphasis & 0b100)) |
+	   dimChannel(colour, 0, !!(emphasis & 0b001) + !!(emphasis & 0b010));
+}
+
+#define EMPHASISED(n) emphasise(universalPalette[(n) & 0x3F], (n) >> 6)
+#define EMPHASISED_8(n) \
+    EMPHASISED((n) + 0), EMPHASISED((n) + 1), EMPHASISED((n) + 2), EMPHASISED((n) + 3), \
+    EMPHASISED((n) + 4), EMPHASISED((n) + 5), EMPHASISED((n) + 6), EMPHASISED((n) + 7)
+#define EMPHASISED_64(n) \
+    EMPHASISED_8((n) + 0x00), EMPHASISED_8((n) + 0x08), EMPHASISED_8((n) + 0x10), \
+    EMPHASISED_8((n) + 0x18), EMPHASISED_8((n) + 0x20), EMPHASISED_8((n) + 0x28), \
+    EMPHASISED_8((n) + 0x30), EMPHASISED_8((n) + 0x38)
+
+constexpr uint32_t emphasisPalette[512] = {
+    EMPHASISED_64(0x000), EMPHASISED_64(0x040), EMPHASISED_64(0x080), EMPHASISED_64(0x0C0),
+    EMPHASISED_64(0x100), EMPHASISED_64(0x140), EMPHASISED_64(0x180), EMPHASISED_64(0x1C0)
+};
+
+#undef EMPHASISED_64
+#undef EMPHASISED_8
+#undef EMPHASISED
+
+#endif
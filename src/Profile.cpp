@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include <Opcodes.h>
+#include <Profile.h>
+
+// lines written for each table of the summary
+static const size_t PROFILE_SUMMARY_LINES = 40;
+
+Profiler::Profiler() : pcCycles(0x10000), opCodeCycles(0x100)
+{
+    // the root, for whatever runs outside of any call
+    Node root = {-1, 0, -1, 0, -1, -1};
+    nodes.push_back(root);
+    resetStack();
+}
+
+void Profiler::resetStack()
+{
+    depth = 0;
+    stack[0].node = 0;
+    stack[0].sp = 0xFF;
+}
+
+void Profiler::enter(uint16_t target, int bank, uint8_t sp)
+{
+    if (depth == PROFILE_MAX_DEPTH) {
+	return;
+    }
+    int parent = stack[depth].node;
+    int node = nodes[parent].child;
+    while (node >= 0 && (nodes[node].target != target || nodes[node].bank != bank)) {
+	node = nodes[node].sibling;
+    }
+    if (node < 0) {
+	Node call = {parent, target, bank, 0, -1, nodes[parent].child};
+	node = nodes.size();
+	nodes.push_back(call);
+	nodes[parent].child = node;
+    }
+    ++depth;
+    stack[depth].node = node;
+    stack[depth].sp = sp;
+}
+
+// the non-zero entries of counts, largest first, and their total
+static std::vector<std::pair<uint64_t, int> > sortCounts(const std::vector<uint64_t> &counts,
+							 uint64_t &total)
+{
+    std::vector<std::pair<uint64_t, int> > sorted;
+    total = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+	if (counts[i]) {
+	    sorted.push_back(std::make_pair(counts[i], (int)i));
+	    total += counts[i];
+	}
+    }
+    std::sort(sorted.rbegin(), sorted.rend());
+    return sorted;
+}
+
+bool Profiler::writeSummary(std::ostream &out)
+{
+    static const char *const TITLES[] = {"pc", "prg bank", "opcode"};
+    const std::vector<uint64_t> *tables[] = {&pcCycles, &bankCycles, &opCodeCycles};
+    for (int t = 0; t < 3; ++t) {
+	uint64_t total;
+	std::vector<std::pair<uint64_t, int> > sorted = sortCounts(*tables[t], total);
+	out << "cycles by " << TITLES[t] << "\n";
+	for (size_t i = 0; i < sorted.size() && i < PROFILE_SUMMARY_LINES; ++i) {
+	    char line[64];
+	    int key = sorted[i].second;
+	    int used = snprintf(line, sizeof(line), "%12llu %6.2f%%  ",
+				(unsigned long long)sorted[i].first, 100.0 * sorted[i].first / total);
+	    if (t == 0) {
+		snprintf(line + used, sizeof(line) - used, "$%04X", key);
+	    } else if (t == 1) {
+		snprintf(line + used, sizeof(line) - used, "%d", key);
+	    } else {
+		snprintf(line + used, sizeof(line) - used, "$%02X %s", key,
+			 OPERATION_NAMES[OPCODES[key].operation]);
+	    }
+	    out << line << "\n";
+	}
+	out << "\n";
+    }
+    return true;
+}
+
+void Profiler::writeStack(std::ostream &out, int node)
+{
+    if (nodes[node].parent < 0) {
+	out << "main";
+	return;
+    }
+    writeStack(out, nodes[node].parent);
+    // calls are named by address, and by bank when they're into prg rom
+    char name[24];
+    if (nodes[node].bank >= 0) {
+	snprintf(name, sizeof(name), ";$%04X@%d", nodes[node].target, nodes[node].bank);
+    } else {
+	snprintf(name, sizeof(name), ";$%04X", nodes[node].target);
+    }
+    out << name;
+}
+
+bool Profiler::writeStacks(std::ostream &out)
+{
+    for (size_t node = 0; node < nodes.size(); ++node) {
+	if (nodes[node].cycles) {
+	    writeStack(out, node);
+	    out << " " << nodes[node].cycles << "\n";
+	}
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/*
+ * Notes:
+ *
+ * - Only built with CPU_PROFILE. Rather than sampling, every interpreted
+ * instruction adds its cycles (including any DMA it started) to its pc,
+ * the 16KB prg bank it ran from and its opcode, for finding where a game
+ * spends its emulated time.
+ *
+ * - Cycles are also added to the current call stack, rebuilt from JSR,
+ * BRK and interrupts. Rather than matching RTS and RTI, a call is over
+ * once the stack pointer rises above where it was just after the call,
+ * which copes with games that pop return addresses or jump through RTS.
+ * The stacks are written in the collapsed format that flamegraph.pl and
+ * similar tools read, with the innermost call last.
+ *
+ * - Without CPU_PROFILE the cpu holds a NoProfile instead, and its calls
+ * are behind a compile time constant, so nothing is left of them.
+ */
+
+// deeper calls are counted against the deepest one
+static const int PROFILE_MAX_DEPTH = 64;
+
+class Profiler
+{
+public:
+    static const bool ENABLED = true;
+    Profiler();
+    // forget the call stack, e.g. on reset
+    void resetStack();
+    void count(uint16_t pc, int bank, uint8_t opCode, int cycles) {
+	pcCycles[pc] += cycles;
+	if (bank >= 0) {
+	    if ((size_t)bank >= bankCycles.size()) {
+		bankCycles.resize(bank + 1);
+	    }
+	    bankCycles[bank] += cycles;
+	}
+	opCodeCycles[opCode] += cycles;
+	nodes[stack[depth].node].cycles += cycles;
+    }
+    // a call to target has just pushed the stack down to sp
+    void enter(uint16_t target, int bank, uint8_t sp);
+    // pops the calls that sp has risen above
+    void leave(uint8_t sp) {
+	while (depth > 0 && sp > stack[depth].sp) {
+	    --depth;
+	}
+    }
+    // the hottest pcs, banks and opcodes
+    bool writeSummary(std::ostream &out);
+    bool writeStacks(std::ostream &out);
+
+private:
+    // a call stack, as a node in a tree of calls from the root
+    struct Node
+    {
+	int parent;
+	uint16_t target;
+	int bank;
+	uint64_t cycles;
+	// first child and next sibling, for finding calls already seen
+	int child;
+	int sibling;
+    };
+    struct Frame
+    {
+	int node;
+	uint8_t sp;
+    };
+
+    void writeStack(std::ostream &out, int node);
+
+    std::vector<uint64_t> pcCycles;
+    std::vector<uint64_t> bankCycles;
+    std::vector<uint64_t> opCodeCycles;
+    std::vector<Node> nodes;
+    Frame stack[PROFILE_MAX_DEPTH + 1];
+    int depth;
+};
+
+class NoProfile
+{
+public:
+    static const bool ENABLED = false;
+    void resetStack() { }
+    void count(uint16_t pc, int bank, uint8_t opCode, int cycles) { }
+    void enter(uint16_t target, int bank, uint8_t sp) { }
+    void leave(uint8_t sp) { }
+    bool writeSummary(std::ostream &out) { return false; }
+    bool writeStacks(std::ostream &out) { return false; }
+};
+
+#endif
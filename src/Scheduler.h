@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+
+/*
+ * Notes:
+ *
+ * - Timestamps are on the master clock, which ticks once per PPU dot
+ * (three times per CPU cycle), and never wrap in practice.
+ *
+ * - Each event source owns a single slot, so scheduling an event
+ * replaces any previously scheduled event from the same source.
+ */
+
+static const int MASTER_CYC_PER_CPU_CYC = 3;
+
+enum Event
+{
+    EVENT_PPU,          // next scanline start, VBlank or end of frame
+    EVENT_TOTAL
+};
+
+class Scheduler
+{
+public:
+    static const uint64_t NEVER = UINT64_MAX;
+
+    Scheduler() {
+	reset();
+    }
+    void reset() {
+	for (int i = 0; i < EVENT_TOTAL; ++i) {
+	    eventTimes[i] = NEVER;
+	}
+    }
+    void schedule(Event event, uint64_t time) {
+	eventTimes[event] = time;
+    }
+    void cancel(Event event) {
+	eventTimes[event] = NEVER;
+    }
+    bool isDue(Event event, uint64_t time) {
+	return eventTimes[event] <= time;
+    }
+    uint64_t getNextEventTime() {
+	uint64_t next = NEVER;
+	for (int i = 0; i < EVENT_TOTAL; ++i) {
+	    if (eventTimes[i] < next) {
+		next = eventTimes[i];
+	    }
+	}
+	return next;
+    }
+
+private:
+    uint64_t eventTimes[EVENT_TOTAL];
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+
+#include <Opcodes.h>
+#include <Trace.h>
+
+static bool isUndocumented(uint8_t opCode)
+{
+    switch (opCode) {
+    case 0x1A: case 0x3A: case 0x5A: case 0x7A: case 0xDA: case 0xFA:
+    case 0xEB:
+	return true; // duplicates of NOP and SBC
+    }
+    return OPCODES[opCode].operation >= OP_JAM;
+}
+
+// the instruction in nestest.log's syntax, without its memory values
+static void disassemble(const TraceEntry &entry, char *text, size_t size)
+{
+    const Opcode &opcode = OPCODES[entry.bytes[0]];
+    const char *name = OPERATION_NAMES[opcode.operation];
+    uint8_t low = entry.bytes[1];
+    uint16_t word = entry.bytes[1] | (entry.bytes[2] << 8);
+    switch (opcode.mode) {
+    case AM_ABS: snprintf(text, size, "%s $%04X", name, word); break;
+    case AM_ABX: snprintf(text, size, "%s $%04X,X", name, word); break;
+    case AM_ABY: snprintf(text, size, "%s $%04X,Y", name, word); break;
+    case AM_ACC: snprintf(text, size, "%s A", name); break;
+    case AM_IMM: snprintf(text, size, "%s #$%02X", name, low); break;
+    case AM_IMP: snprintf(text, size, "%s", name); break;
+    case AM_IND: snprintf(text, size, "%s ($%04X)", name, word); break;
+    case AM_INX: snprintf(text, size, "%s ($%02X,X)", name, low); break;
+    case AM_INY: snprintf(text, size, "%s ($%02X),Y", name, low); break;
+    case AM_REL:
+	snprintf(text, size, "%s $%04X", name, (uint16_t)(entry.pc + 2 + (int8_t)low));
+	break;
+    case AM_ZPG: snprintf(text, size, "%s $%02X", name, low); break;
+    case AM_ZPX: snprintf(text, size, "%s $%02X,X", name, low); break;
+    case AM_ZPY: snprintf(text, size, "%s $%02X,Y", name, low); break;
+    }
+}
+
+bool TraceBuffer::write(std::ostream &out)
+{
+    size_t count = full ? TRACE_SIZE : next;
+    size_t first = full ? next : 0;
+    for (size_t i = 0; i < count; ++i) {
+	const TraceEntry &entry = entries[(first + i) % TRACE_SIZE];
+	char bytes[16] = "";
+	int used = 0;
+	for (int b = 0; b < entry.length; ++b) {
+	    used += snprintf(bytes + used, sizeof(bytes) - used, b ? " %02X" : "%02X", entry.bytes[b]);
+	}
+	char instr[40];
+	disassemble(entry, instr, sizeof(instr));
+	char line[128];
+	snprintf(line, sizeof(line), "%04X  %-8s %c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+		 entry.pc, bytes, isUndocumented(entry.bytes[0]) ? '*' : ' ', instr,
+		 entry.acc, entry.x, entry.y, entry.status, entry.sp,
+		 (unsigned long long)entry.cycles);
+	out << line;
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/*
+ * Notes:
+ *
+ * - Only built with CPU_TRACE. The cpu records every instruction it
+ * interprets into a ring buffer, which is written out as text in the
+ * layout of nestest.log, so that traces from two builds can be diffed
+ * to find where they diverge.
+ *
+ * - The lines leave out nestest's PPU column and the memory values it
+ * annotates operands with, since reading those back could have side
+ * effects. The registers and CYC are in the same columns.
+ *
+ * - Without CPU_TRACE the cpu holds a NoTrace instead, and its calls are
+ * behind a compile time constant, so nothing is left of them.
+ */
+
+static const size_t TRACE_SIZE = 1 << 16;
+
+struct TraceEntry
+{
+    uint16_t pc;
+    // the opcode and its operand bytes
+    uint8_t bytes[3];
+    uint8_t length;
+    uint8_t acc;
+    uint8_t x;
+    uint8_t y;
+    uint8_t status;
+    uint8_t sp;
+    uint64_t cycles;
+};
+
+class TraceBuffer
+{
+public:
+    static const bool ENABLED = true;
+    TraceBuffer() : entries(TRACE_SIZE), next(0), full(false) { }
+    void record(const TraceEntry &entry) {
+	entries[next] = entry;
+	next = (next + 1) % TRACE_SIZE;
+	full = full || next == 0;
+    }
+    // writes the recorded instructions, oldest first
+    bool write(std::ostream &out);
+
+private:
+    std::vector<TraceEntry> entries;
+    size_t next;
+    bool full;
+};
+
+class NoTrace
+{
+public:
+    static const bool ENABLED = false;
+    void record(const TraceEntry &entry) { }
+    bool write(std::ostream &out) { return false; }
+};
+
+#endif
@@ -41,10 +41,10 @@ void clearNextFrame()
     gui.clearRenderTarget();
 }
 
-void displayFrameBuffer()
+void displayFrameBuffer(bool frameChanged)
 {
     uint32_t *frameBuffer = console.getFrameBuffer();
-    gui.renderAndDisplayFrame(frameBuffer);
+    gui.renderAndDisplayFrame(frameBuffer, frameChanged);
 }
 
 void handleEvents()
@@ -77,10 +77,12 @@ void runEmulation()
     while (!isQuitting) {
 	handleEvents();
 	clearNextFrame();
+	bool frameChanged = false;
         if (!isPaused) {
             console.runForOneFrame();
+	    frameChanged = console.frameChanged();
         }
-	displayFrameBuffer();
+	displayFrameBuffer(frameChanged);
 	playSound();
 	timer.delay();
     }
@@ -88,6 +90,12 @@ void runEmulation()
 
 int main(int argc, char *args[])
 {
+    // --dot-ppu for the games that need the ppu stepped a dot at a time
+    if (argc > 1 && std::string(args[1]) == "--dot-ppu") {
+	console.setPpuBackend(PPU_BACKEND_DOT);
+	++args;
+	--argc;
+    }
     if (argc < 2) {
 	printf("Rom path not provided\n");
 	return 1;
@@ -1,8 +1,22 @@
 #include <cstdint>
 
 #include <CartMemory.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
+#include <NameTableMap.h>
 #include <mappers/Mapper0.h>
 
+Mapper0::Mapper0(CartMemory mem, MemoryMap *memoryMap, ChrMap *chrMap,
+                 NameTableMap *nameTableMap) : Mapper(mem, memoryMap, chrMap, nameTableMap)
+{
+    // prg ram writes are ignored, so only map it for reads
+    memoryMap->mapReadOnly(0x6000, 0x2000, cartMemory.ram.data());
+    // 16KB roms are mirrored into the upper half
+    memoryMap->mapReadOnly(0x8000, 0x4000, cartMemory.prg.data());
+    memoryMap->mapReadOnly(0xC000, 0x4000, cartMemory.prg.data() + (0xC000 % cartMemory.prg.size()));
+    chrMap->map(0x0000, 0x2000, cartMemory.chr.data(), cartMemory.chr.size(), 0);
+}
+
 uint8_t Mapper0::readPrg(uint16_t addr)
 {
     if (addr >= 0x8000) {
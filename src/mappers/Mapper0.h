@@ -2,12 +2,15 @@
 #define MAPPER_0_H
 
 #include <CartMemory.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
 #include <Mapper.h>
+#include <NameTableMap.h>
 
 class Mapper0: public Mapper
 {
 public:
-    Mapper0(CartMemory mem) : Mapper(mem) { };
+    Mapper0(CartMemory mem, MemoryMap *memoryMap, ChrMap *chrMap, NameTableMap *nameTableMap);
     uint8_t readPrg(uint16_t addr);
     uint8_t readChr(uint16_t addr);
     void writeChr(uint16_t addr, uint8_t value);
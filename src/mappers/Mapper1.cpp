@@ -1,9 +1,14 @@
 #include <cstdint>
 
 #include <CartMemory.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
+#include <NameTableMap.h>
 #include <mappers/Mapper1.h>
 
-Mapper1::Mapper1(CartMemory mem) : Mapper(mem) {
+Mapper1::Mapper1(CartMemory mem, MemoryMap *memoryMap, ChrMap *chrMap,
+                 NameTableMap *nameTableMap) : Mapper(mem, memoryMap, chrMap, nameTableMap) {
+    memoryMap->map(0x6000, 0x2000, cartMemory.ram.data());
     updateBankAddresses();
 }
 
@@ -41,13 +46,14 @@ void Mapper1::writePrg(uint16_t addr, uint8_t value) {
 }
 
 uint8_t Mapper1::readChr(uint16_t addr) {
-    int index = decodeChrRomAddress(addr);
+    int index = decodeChrRomAddress(addr) % cartMemory.chr.size();
     return cartMemory.chr[index];
 }
 
 void Mapper1::writeChr(uint16_t addr, uint8_t value) {
     if (cartMemory.chrIsRam) {
-	int index = addr % cartMemory.chr.size();
+	// banked like reads, so writes land where the ppu sees them
+	int index = decodeChrRomAddress(addr) % cartMemory.chr.size();
         cartMemory.chr[index] = value;
     }
 }
@@ -62,10 +68,10 @@ void Mapper1::loadRegister(uint16_t addr, uint8_t value) {
 	chrRomBank0 = value & 0x1F;
     } else if (addr >= 0x8000) {
 	switch(value & 0b00011) {
-	case 0: cartMemory.mirroring = Mirroring::MIRROR_LOWER_BANK; break;
-	case 1: cartMemory.mirroring = Mirroring::MIRROR_UPPER_BANK; break;
-	case 2: cartMemory.mirroring = Mirroring::MIRROR_VERTICAL;   break;
-	case 3: cartMemory.mirroring = Mirroring::MIRROR_HORIZONTAL; break;
+	case 0: setMirroring(Mirroring::MIRROR_LOWER_BANK); break;
+	case 1: setMirroring(Mirroring::MIRROR_UPPER_BANK); break;
+	case 2: setMirroring(Mirroring::MIRROR_VERTICAL);   break;
+	case 3: setMirroring(Mirroring::MIRROR_HORIZONTAL); break;
 	}
 	switch((value & 0b01100) >> 2) {
 	case 0:
@@ -96,6 +102,10 @@ void Mapper1::updateBankAddresses() {
 	prg16kBankAddresses[1] = cartMemory.prg.size() - 0x4000;
 	break;
     }
+    prg16kBankAddresses[0] %= cartMemory.prg.size();
+    prg16kBankAddresses[1] %= cartMemory.prg.size();
+    memoryMap->mapReadOnly(0x8000, 0x4000, &cartMemory.prg[prg16kBankAddresses[0]]);
+    memoryMap->mapReadOnly(0xC000, 0x4000, &cartMemory.prg[prg16kBankAddresses[1]]);
 
     switch(chrMode) {
     case ChrMode::CHR_8KB:
@@ -107,6 +117,8 @@ void Mapper1::updateBankAddresses() {
 	chr4kBankAddresses[1] = chrRomBank1 * 0x1000;
 	break;
     }
+    chrMap->map(0x0000, 0x1000, cartMemory.chr.data(), cartMemory.chr.size(), chr4kBankAddresses[0]);
+    chrMap->map(0x1000, 0x1000, cartMemory.chr.data(), cartMemory.chr.size(), chr4kBankAddresses[1]);
 }
 
 int Mapper1::decodePrgRomAddress(uint16_t addr) {
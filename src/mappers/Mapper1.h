@@ -2,7 +2,10 @@
 #define MAPPER_1_H
 
 #include <CartMemory.h>
+#include <ChrMap.h>
+#include <MemoryMap.h>
 #include <Mapper.h>
+#include <NameTableMap.h>
 
 enum PrgMode {
     PRG_32KB,
@@ -17,7 +20,7 @@ enum ChrMode {
 
 class Mapper1: public Mapper {
 public:
-    Mapper1(CartMemory mem);
+    Mapper1(CartMemory mem, MemoryMap *memoryMap, ChrMap *chrMap, NameTableMap *nameTableMap);
     uint8_t readPrg(uint16_t addr);
     void writePrg(uint16_t addr, uint8_t value);
     uint8_t readChr(uint16_t addr);
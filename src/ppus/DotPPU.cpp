@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <ChrMap.h>
+#include <PPU.h>
+#include <ppus/DotPPU.h>
+
+static uint8_t reverseBits(uint8_t value)
+{
+    value = ((value & 0xF0) >> 4) | ((value & 0x0F) << 4);
+    value = ((value & 0xCC) >> 2) | ((value & 0x33) << 2);
+    return ((value & 0xAA) >> 1) | ((value & 0x55) << 1);
+}
+
+void DotPPU::reset()
+{
+    PPU::reset();
+    nameTableByte = 0;
+    attributeBits = 0;
+    patternLow = 0;
+    patternHigh = 0;
+    bgShiftLow = 0;
+    bgShiftHigh = 0;
+    attributeShiftLow = 0;
+    attributeShiftHigh = 0;
+    clearSecondaryOam();
+    sprCount = 0;
+    a12 = false;
+    memset(line, 0, sizeof(line));
+}
+
+void DotPPU::renderUntil(int cycle)
+{
+    while (renderCycle < cycle) {
+	int scanlNum = renderCycle / CYC_PER_SCANL;
+	int lineStart = scanlNum * CYC_PER_SCANL;
+	int end = std::min(cycle, lineStart + CYC_PER_SCANL);
+	if (scanlNum < (int)FRAME_HEIGHT || scanlNum == SCANL_PER_FRAME - 1) {
+	    for (int dot = renderCycle - lineStart; dot < end - lineStart; ++dot) {
+		tick(scanlNum, dot);
+	    }
+	}
+	renderCycle = end;
+    }
+}
+
+void DotPPU::tick(int scanlNum, int dot)
+{
+    bool visible = scanlNum < (int)FRAME_HEIGHT;
+    bool rendering = showBg || showSpr;
+    if (rendering) {
+	if ((dot >= 2 && dot <= 257) || (dot >= 322 && dot <= 337)) {
+	    bgShiftLow <<= 1;
+	    bgShiftHigh <<= 1;
+	    attributeShiftLow <<= 1;
+	    attributeShiftHigh <<= 1;
+	}
+	if ((dot >= 1 && dot <= 256) || (dot >= 321 && dot <= 336)) {
+	    fetchBackground(dot);
+	}
+    }
+    if (visible && dot >= 1 && dot <= 256) {
+	drawPixel(dot - 1);
+    }
+    if (rendering) {
+	if (dot == 256) {
+	    incrementY();
+	} else if (dot == 257) {
+	    loadBackgroundShifters();
+	    vRamAddr = (vRamAddr & ~LOOPY_HORIZONTAL) | (tempVRamAddr & LOOPY_HORIZONTAL);
+	} else if (!visible && dot >= 280 && dot <= 304) {
+	    vRamAddr = (vRamAddr & ~LOOPY_VERTICAL) | (tempVRamAddr & LOOPY_VERTICAL);
+	} else if (dot == 337 || dot == 339) {
+	    // unused name table fetches
+	    nameTableByte = readNameTables(vRamAddr & 0x0FFF);
+	    a12 = false;
+	}
+
+	// secondary oam is cleared over dots 1-64, then filled with the
+	// sprites on the next line over 65-256. None are on line 0.
+	if (dot == 64) {
+	    clearSecondaryOam();
+	} else if (visible && dot >= 65 && dot <= 256 && (dot & 1)) {
+	    evaluateSprite(scanlNum);
+	} else if (dot >= 257 && dot <= 320) {
+	    fetchSprite(scanlNum, dot);
+	}
+    }
+    if (visible && dot == 256) {
+	outputLine(scanlNum, line);
+    }
+}
+
+void DotPPU::fetchBackground(int dot)
+{
+    switch ((dot - 1) & 0x7) {
+    case 0:
+	loadBackgroundShifters();
+	nameTableByte = readNameTables(vRamAddr & 0x0FFF);
+	a12 = false;
+	break;
+    case 2: {
+	uint8_t attribute = readNameTables(0x3C0 | (vRamAddr & LOOPY_NAME_TABLE) |
+					   ((vRamAddr >> 4) & 0x38) | ((vRamAddr >> 2) & 0x07));
+	int shift = ((vRamAddr >> 4) & 0x4) | (vRamAddr & 0x2);
+	attributeBits = (attribute >> shift) & 0x3;
+	a12 = false;
+    } break;
+    case 4:
+	patternLow = fetchPattern((bgPatternTableSelector ? 0x1000 : 0) +
+				  nameTableByte * 16 + (vRamAddr >> 12));
+	break;
+    case 6:
+	patternHigh = fetchPattern((bgPatternTableSelector ? 0x1000 : 0) +
+				   nameTableByte * 16 + (vRamAddr >> 12) + 8);
+	break;
+    case 7:
+	incrementX();
+	break;
+    }
+}
+
+void DotPPU::loadBackgroundShifters()
+{
+    bgShiftLow = (bgShiftLow & 0xFF00) | patternLow;
+    bgShiftHigh = (bgShiftHigh & 0xFF00) | patternHigh;
+    attributeShiftLow = (attributeShiftLow & 0xFF00) | ((attributeBits & 0x1) ? 0xFF : 0);
+    attributeShiftHigh = (attributeShiftHigh & 0xFF00) | ((attributeBits & 0x2) ? 0xFF : 0);
+}
+
+void DotPPU::clearSecondaryOam()
+{
+    memset(secondaryOam, 0xFF, sizeof(secondaryOam));
+    secondaryCount = 0;
+    spr0InSecondary = false;
+    evalSprite = 0;
+    evalByte = 0;
+    evalDone = false;
+}
+
+void DotPPU::evaluateSprite(int scanlNum)
+{
+    if (evalDone) {
+	return;
+    }
+    uint8_t value = oam[evalSprite * 4 + evalByte];
+    int row = scanlNum - value;
+    bool inRange = row >= 0 && row < (bigSprites ? 16 : 8);
+    bool nextSprite = false;
+    if (secondaryCount < SPR_PER_SCANL) {
+	secondaryOam[secondaryCount * 4 + evalByte] = value;
+	if (evalByte > 0) {
+	    // copying the rest of a sprite that's in range
+	    if (++evalByte == 4) {
+		evalByte = 0;
+		++secondaryCount;
+		nextSprite = true;
+	    }
+	} else if (inRange) {
+	    evalByte = 1;
+	    if (evalSprite == 0) {
+		spr0InSecondary = true;
+	    }
+	} else {
+	    nextSprite = true;
+	}
+    } else if (inRange) {
+	sprOverflow = true;
+	evalDone = true;
+    } else {
+	// the hardware also steps to the next byte here, so the overflow
+	// check reads tiles, attributes and x positions as y positions
+	evalByte = (evalByte + 1) & 0x3;
+	nextSprite = true;
+    }
+    if (nextSprite && ++evalSprite == 64) {
+	evalDone = true;
+    }
+}
+
+void DotPPU::fetchSprite(int scanlNum, int dot)
+{
+    int slot = (dot - 257) / 8;
+    const uint8_t *entry = &secondaryOam[slot * 4];
+    if (dot == 257) {
+	sprCount = secondaryCount;
+	spr0OnLine = spr0InSecondary;
+    }
+
+    // unused slots are fetched too, as tile $FF
+    int row = scanlNum - entry[0];
+    uint16_t addr;
+    if (bigSprites) {
+	row &= 0xF;
+	if (entry[2] & 0x80) {
+	    row = 15 - row;
+	}
+	addr = ((entry[1] & 0x01) ? 0x1000 : 0) + (entry[1] & 0xFE) * 16 + (row & 0x8) * 2 + (row & 0x7);
+    } else {
+	row &= 0x7;
+	if (entry[2] & 0x80) {
+	    row = 7 - row;
+	}
+	addr = (sprPatternTableSelector ? 0x1000 : 0) + entry[1] * 16 + row;
+    }
+
+    switch ((dot - 257) & 0x7) {
+    case 0:
+    case 2:
+	// unused name table and attribute fetches
+	a12 = false;
+	break;
+    case 4:
+	sprShiftLow[slot] = fetchPattern(addr);
+	break;
+    case 6:
+	sprShiftHigh[slot] = fetchPattern(addr + 8);
+	if (slot >= secondaryCount) {
+	    sprShiftLow[slot] = 0;
+	    sprShiftHigh[slot] = 0;
+	} else if (entry[2] & 0x40) {
+	    sprShiftLow[slot] = reverseBits(sprShiftLow[slot]);
+	    sprShiftHigh[slot] = reverseBits(sprShiftHigh[slot]);
+	}
+	sprAttribute[slot] = entry[2];
+	sprX[slot] = entry[3];
+	break;
+    }
+}
+
+void DotPPU::drawPixel(int x)
+{
+    uint8_t bgPixel = 0;
+    if (showBg && (x >= 8 || imageMask)) {
+	uint16_t bit = 0x8000 >> fineXScroll;
+	uint8_t pattern = ((bgShiftLow & bit) ? 1 : 0) | ((bgShiftHigh & bit) ? 2 : 0);
+	if (pattern) {
+	    bgPixel = ((attributeShiftHigh & bit) ? 8 : 0) | ((attributeShiftLow & bit) ? 4 : 0) | pattern;
+	}
+    }
+
+    // the first opaque sprite pixel is the one seen, whatever its priority
+    uint8_t sprPixel = 0;
+    bool behindBg = false;
+    bool spr0 = false;
+    if (showBg || showSpr) {
+	for (int i = 0; i < sprCount; ++i) {
+	    if (sprX[i]) {
+		--sprX[i];
+		continue;
+	    }
+	    uint8_t pattern = ((sprShiftHigh[i] >> 6) & 0x2) | ((sprShiftLow[i] >> 7) & 0x1);
+	    sprShiftLow[i] <<= 1;
+	    sprShiftHigh[i] <<= 1;
+	    if (pattern && !sprPixel && showSpr && (x >= 8 || sprMask)) {
+		sprPixel = 0x10 | ((sprAttribute[i] & 0x3) << 2) | pattern;
+		behindBg = !!(sprAttribute[i] & 0x20);
+		spr0 = i == 0 && spr0OnLine;
+	    }
+	}
+    }
+
+    if (spr0 && bgPixel && x != 255 && !spr0Latch) {
+	spr0Hit = true;
+	spr0Latch = true;
+    }
+    line[x] = (sprPixel && (!behindBg || !bgPixel)) ? sprPixel : bgPixel;
+}
+
+uint8_t DotPPU::fetchPattern(uint16_t addr)
+{
+    bool high = !!(addr & 0x1000);
+    if (high && !a12) {
+	cart->clockA12();
+    }
+    a12 = high;
+    return readPatternTables(addr);
+}
@@ -0,0 +1,79 @@
+#ifndef DOT_PPU_H
+#define DOT_PPU_H
+
+#include <cstdint>
+
+#include <Cart.h>
+#include <ChrMap.h>
+#include <NameTableMap.h>
+#include <PPU.h>
+
+/*
+ * Notes:
+ *
+ * - Steps the hardware's rendering a dot at a time: the background's
+ * name table, attribute and pattern fetches every 2 dots into 16 bit shift
+ * registers, sprite evaluation into secondary oam a byte every 2 dots
+ * (including the overflow flag's bug), and the sprite fetches into their
+ * own shift registers and x counters over dots 257-320.
+ *
+ * - Each rising edge of A12 on the pattern fetches is passed on to the
+ * mapper, unfiltered.
+ *
+ * - Much slower than ScanlinePPU, so it's picked per game, and kept
+ * around to check the scanline backend against.
+ */
+
+class DotPPU: public PPU
+{
+public:
+    DotPPU(Cart *cart, ChrMap *chrMap, NameTableMap *nameTableMap, NMI nmi) :
+	PPU(cart, chrMap, nameTableMap, nmi) { }
+    void reset();
+    const char *getName() { return "dot"; }
+
+protected:
+    void renderUntil(int cycle);
+
+private:
+    void tick(int scanlNum, int dot);
+    void fetchBackground(int dot);
+    void loadBackgroundShifters();
+    void clearSecondaryOam();
+    void evaluateSprite(int scanlNum);
+    void fetchSprite(int scanlNum, int dot);
+    void drawPixel(int x);
+    uint8_t fetchPattern(uint16_t addr);
+
+    // background fetches, and the shift registers they're loaded into
+    uint8_t nameTableByte;
+    uint8_t attributeBits;
+    uint8_t patternLow;
+    uint8_t patternHigh;
+    uint16_t bgShiftLow;
+    uint16_t bgShiftHigh;
+    uint16_t attributeShiftLow;
+    uint16_t attributeShiftHigh;
+
+    // sprite evaluation for the next line
+    uint8_t secondaryOam[SPR_PER_SCANL * 4];
+    int secondaryCount;
+    bool spr0InSecondary;
+    int evalSprite;             // n, the oam entry being looked at
+    int evalByte;               // m, the byte of it
+    bool evalDone;
+
+    // sprites on the line being drawn
+    int sprCount;
+    uint8_t sprShiftLow[SPR_PER_SCANL];
+    uint8_t sprShiftHigh[SPR_PER_SCANL];
+    uint8_t sprAttribute[SPR_PER_SCANL];
+    uint8_t sprX[SPR_PER_SCANL];
+
+    // whether A12 was set on the last fetch
+    bool a12;
+    // palette indices of the current scanline
+    uint8_t line[FRAME_WIDTH];
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <ChrCache.h>
+#include <ChrMap.h>
+#include <Compositor.h>
+#include <Graphics.h>
+#include <PPU.h>
+#include <ppus/ScanlinePPU.h>
+
+void ScanlinePPU::reset()
+{
+    PPU::reset();
+    buildSpriteData();
+    chrCache.reset(chrMap->getChr(), chrMap->getChrSize());
+    dirtySprites = ~(uint64_t)0;
+    chrGeneration = chrMap->getGeneration();
+    chrWriteLow = 0x2000;
+    chrWriteHigh = -1;
+    memset(bgTiles, 0, sizeof(bgTiles));
+    memset(sprLine, 0, sizeof(sprLine));
+}
+
+void ScanlinePPU::setCTRL(uint8_t value)
+{
+    if (sprPatternTableSelector != !!(value & 0x08) ||
+	bigSprites != !!(value & 0x20)) {
+	dirtySprites = ~(uint64_t)0;
+    }
+    PPU::setCTRL(value);
+}
+
+void ScanlinePPU::setOAMDATA(uint8_t value)
+{
+    uint8_t addr = oamAddrBuffer;
+    uint8_t old = oam[addr];
+    PPU::setOAMDATA(value);
+    if (oam[addr] != old) {
+	dirtySprites |= (uint64_t)1 << (addr >> 2);
+    }
+}
+
+void ScanlinePPU::writeOAMPage(const uint8_t *page)
+{
+    dirtySprites |= copyOAMPage(page);
+}
+
+void ScanlinePPU::fetchTile(int slot)
+{
+    if (renderSkipped && !spr0OnLine) {
+	// nothing to draw, and no sprite 0 to hit
+	incrementX();
+	return;
+    }
+    uint8_t tile = readNameTables(vRamAddr & 0x0FFF);
+    uint8_t attribute = readNameTables(0x3C0 | (vRamAddr & LOOPY_NAME_TABLE) |
+				       ((vRamAddr >> 4) & 0x38) | ((vRamAddr >> 2) & 0x07));
+    // position within the enclosing metatile picks 2 of its bits
+    int shift = ((vRamAddr >> 4) & 0x4) | (vRamAddr & 0x2);
+    uint8_t selector = ((attribute >> shift) & 0x3) << 2;
+    uint16_t addr = (bgPatternTableSelector ? 0x1000 : 0) + tile * 16 + (vRamAddr >> 12);
+    const uint8_t *row = chrCache.getRow(chrMap->getOffset(addr), false);
+    for (int column = 0; column < 8; ++column) {
+	bgTiles[slot][column] = selector | row[column];
+    }
+    incrementX();
+}
+
+void ScanlinePPU::evaluateSprites(int y)
+{
+    memset(sprLine, 0, sizeof(sprLine));
+    spr0OnLine = false;
+    if (!showBg && !showSpr) {
+	return;
+    }
+    reloadSpriteData();
+    // only the first 8 sprites on the line are drawn, and the first
+    // with an opaque pixel is the one seen there
+    int found = 0;
+    for (int i = 0; i < 64; ++i) {
+	const Sprite &sprite = sprites[i];
+	if (sprite.yPos > y || sprite.yBound <= y) {
+	    continue;
+	}
+	if (found == SPR_PER_SCANL) {
+	    sprOverflow = true;
+	    break;
+	}
+	++found;
+	if (!sprite.visible || !showSpr || (renderSkipped && sprite.oamIndex != 0)) {
+	    continue;
+	}
+	uint8_t flags = sprite.paletteSelect;
+	if (sprite.priority) {
+	    flags |= SPR_LINE_BEHIND_BG;
+	}
+	if (sprite.oamIndex == 0) {
+	    flags |= SPR_LINE_SPRITE_0;
+	    spr0OnLine = true;
+	}
+	const uint8_t *row = sprite.rows[y - sprite.yPos];
+	for (int column = 0; column < 8 && sprite.xPos + column < FRAME_WIDTH; ++column) {
+	    uint8_t *pixel = &sprLine[sprite.xPos + column];
+	    if (!*pixel && row[column]) {
+		*pixel = flags | row[column];
+	    }
+	}
+    }
+}
+
+void ScanlinePPU::drawPixels(int from, int to)
+{
+    if (renderSkipped && (!spr0OnLine || spr0Latch)) {
+	return;
+    }
+    while (from < to) {
+	// the masks may change mid line, and the left 8 columns have their own
+	int end = from < 8 ? std::min(to, 8) : to;
+	int count = end - from;
+	if (showBg && (from >= 8 || imageMask)) {
+	    memcpy(&bgLine[from], &bgTiles[0][0] + from + fineXScroll, count);
+	} else {
+	    memset(&bgLine[from], 0, count);
+	}
+	if (!showSpr || (from < 8 && !sprMask)) {
+	    memset(&sprLine[from], 0, count);
+	}
+	if (spr0OnLine && !spr0Latch) {
+	    for (int x = from; x < end && x != 255; ++x) {
+		if ((sprLine[x] & SPR_LINE_SPRITE_0) && (bgLine[x] & 0x3)) {
+		    spr0Hit = true;
+		    spr0Latch = true;
+		    break;
+		}
+	    }
+	}
+	from = end;
+    }
+}
+
+void ScanlinePPU::outputScanline(int scanlNum)
+{
+    if (renderSkipped || reusingFrame) {
+	return;
+    }
+    uint8_t line[FRAME_WIDTH];
+    compositor.compose(bgLine, sprLine, line);
+    outputLine(scanlNum, line);
+}
+
+void ScanlinePPU::renderDots(int scanlNum, int from, int to)
+{
+    bool rendering = showBg || showSpr;
+    bool preRender = scanlNum == SCANL_PER_FRAME - 1;
+    if (rendering) {
+	// tiles 2-33 of the line are fetched every 8 dots from dot 8
+	int slot = std::max(2, (from + 7) / 8 + 1);
+	for (; slot < BG_TILE_SLOTS && (slot - 1) * 8 < to; ++slot) {
+	    fetchTile(slot);
+	}
+    }
+    if (!preRender) {
+	// pixel x comes out at dot x + 1
+	int first = std::max(from, 1) - 1;
+	int last = std::min(to, (int)FRAME_WIDTH + 1) - 1;
+	if (first < last) {
+	    drawPixels(first, last);
+	}
+	if (from <= 256 && 256 < to) {
+	    outputScanline(scanlNum);
+	}
+    }
+    if (rendering) {
+	if (from <= 256 && 256 < to) {
+	    incrementY();
+	}
+	if (from <= 257 && 257 < to) {
+	    vRamAddr = (vRamAddr & ~LOOPY_HORIZONTAL) | (tempVRamAddr & LOOPY_HORIZONTAL);
+	}
+	if (preRender && from <= 280 && 280 < to) {
+	    vRamAddr = (vRamAddr & ~LOOPY_VERTICAL) | (tempVRamAddr & LOOPY_VERTICAL);
+	}
+    }
+    if (from <= 257 && 257 < to) {
+	// sprites for the next line, of which there are none on line 0
+	evaluateSprites(preRender ? -1 : scanlNum + 1);
+    }
+    if (rendering) {
+	// and its first two tiles
+	for (int slot = 0; slot < 2; ++slot) {
+	    int dot = 328 + slot * 8;
+	    if (from <= dot && dot < to) {
+		fetchTile(slot);
+	    }
+	}
+    }
+}
+
+void ScanlinePPU::renderUntil(int cycle)
+{
+    while (renderCycle < cycle) {
+	int scanlNum = renderCycle / CYC_PER_SCANL;
+	int lineStart = scanlNum * CYC_PER_SCANL;
+	int end = std::min(cycle, lineStart + CYC_PER_SCANL);
+	if (scanlNum < FRAME_HEIGHT || scanlNum == SCANL_PER_FRAME - 1) {
+	    renderDots(scanlNum, renderCycle - lineStart, end - lineStart);
+	}
+	renderCycle = end;
+    }
+}
+
+void ScanlinePPU::writePatternTables(uint16_t index, uint8_t value)
+{
+    PPU::writePatternTables(index, value);
+    chrCache.invalidate(chrMap->getOffset(index));
+    // only sprites with tiles in the range written need rebuilding
+    if (index < chrWriteLow) {
+	chrWriteLow = index;
+    }
+    if (index > chrWriteHigh) {
+	chrWriteHigh = index;
+    }
+}
+
+void ScanlinePPU::buildSpriteData()
+{
+    for (int i = 0; i < 64; i++) {
+	sprites[i].oamIndex = i * 4;
+	sprites[i].patternAddr = 0;
+    }
+}
+
+void ScanlinePPU::reloadSpriteData()
+{
+    if (chrMap->getGeneration() != chrGeneration) {
+	// chr banks were switched
+	chrGeneration = chrMap->getGeneration();
+	dirtySprites = ~(uint64_t)0;
+    }
+    if (chrWriteLow <= chrWriteHigh) {
+	int size = bigSprites ? 32 : 16;
+	for (int i = 0; i < 64; ++i) {
+	    if (sprites[i].patternAddr <= chrWriteHigh &&
+		sprites[i].patternAddr + size > chrWriteLow) {
+		dirtySprites |= (uint64_t)1 << i;
+	    }
+	}
+	chrWriteLow = 0x2000;
+	chrWriteHigh = -1;
+    }
+    for (int i = 0; dirtySprites; ++i, dirtySprites >>= 1) {
+	if (dirtySprites & 1) {
+	    reloadSprite(i);
+	}
+    }
+}
+
+void ScanlinePPU::reloadSprite(int i)
+{
+    sprites[i].xPos = oam[sprites[i].oamIndex + 3];
+    // sprites past x 248 are still partly seen, but none below line 239
+    sprites[i].visible = oam[sprites[i].oamIndex] < 0xEF;
+
+    sprites[i].yPos = oam[sprites[i].oamIndex] + 1;
+    sprites[i].xBound = (int)(sprites[i].xPos) + 8;
+    sprites[i].yBound = (int)(sprites[i].yPos) + (bigSprites ? 16 : 8);
+
+    if (!sprites[i].visible) {
+	return;
+    }
+
+    int patternTableIndex = 0;
+    if (bigSprites) {
+	// 8x16 sprite
+	patternTableIndex = (oam[sprites[i].oamIndex + 1] & 0b11111110) * 16;
+	if (oam[sprites[i].oamIndex + 1] & 0b00000001) {
+	    patternTableIndex += 0x1000;
+	}
+    } else {
+	// 8x8 sprite
+	patternTableIndex = oam[sprites[i].oamIndex + 1] * 16;
+	if (sprPatternTableSelector) {
+	    patternTableIndex += 0x1000;
+	}
+    }
+    sprites[i].patternAddr = patternTableIndex;
+
+    sprites[i].paletteSelect =
+	((oam[sprites[i].oamIndex + 2] & 0b00000011) << 2) | 0x10;
+    sprites[i].priority = !!(oam[sprites[i].oamIndex + 2] & 0b00100000);
+    sprites[i].flipHor  = !!(oam[sprites[i].oamIndex + 2] & 0b01000000);
+    sprites[i].flipVert = !!(oam[sprites[i].oamIndex + 2] & 0b10000000);
+
+    // copy in the decoded rows, already flipped
+    int height = bigSprites ? 16 : 8;
+    for (int y = 0; y < height; ++y) {
+	int patternRow = sprites[i].flipVert ? height - 1 - y : y;
+	if (patternRow > 7) {
+	    // second tile of an 8x16 sprite
+	    patternRow += 8;
+	}
+	const uint8_t *row = chrCache.getRow(chrMap->getOffset(patternTableIndex + patternRow),
+					     sprites[i].flipHor);
+	memcpy(sprites[i].rows[y], row, 8);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SCANLINE_PPU_H
+#define SCANLINE_PPU_H
+
+#include <cstdint>
+
+#include <Cart.h>
+#include <ChrCache.h>
+#include <ChrMap.h>
+#include <Graphics.h>
+#include <NameTableMap.h>
+#include <PPU.h>
+
+/*
+ * Notes:
+ *
+ * - Background tiles are fetched, and v incremented, on the dots that the
+ * hardware does, but a whole tile at a time from the chr cache, and pixels
+ * are drawn in runs between register writes. Sprites are evaluated all at
+ * once at dot 257, from pre-decoded rows that are only rebuilt when their
+ * oam entry or chr changes.
+ *
+ * - With rendering skipped, only sprite 0 is put into the line's sprites,
+ * and the background only fetched and drawn on lines it's on, until it
+ * hits. A reused frame is drawn in full, but not composited, so that it
+ * can carry on from any dot once something changes.
+ *
+ * - Nothing is fetched a dot at a time, so mappers watching the ppu
+ * address bus (A12) see nothing; those games need DotPPU.
+ */
+
+// tiles fetched for a line, 2 more than fit to allow for fine x scrolling
+static const int BG_TILE_SLOTS = 34;
+
+class ScanlinePPU: public PPU
+{
+public:
+    ScanlinePPU(Cart *cart, ChrMap *chrMap, NameTableMap *nameTableMap, NMI nmi) :
+	PPU(cart, chrMap, nameTableMap, nmi) { }
+    void reset();
+    void setCTRL(uint8_t value);
+    void setOAMDATA(uint8_t value);
+    void writeOAMPage(const uint8_t *page);
+    const char *getName() { return "scanline"; }
+
+protected:
+    void renderUntil(int cycle);
+    void writePatternTables(uint16_t addr, uint8_t value);
+
+private:
+    void renderDots(int scanlNum, int from, int to);
+    void fetchTile(int slot);
+    void evaluateSprites(int y);
+    void drawPixels(int from, int to);
+    void outputScanline(int scanlNum);
+    void buildSpriteData();
+    void reloadSpriteData();
+    void reloadSprite(int i);
+
+    ChrCache chrCache;
+
+    // decoded tiles fetched for the current scanline
+    uint8_t bgTiles[BG_TILE_SLOTS][8];
+    // 4 bit palette indices of the background on the current scanline
+    uint8_t bgLine[FRAME_WIDTH];
+    // and of the sprites, with SPR_LINE_* flags, evaluated on the line before
+    uint8_t sprLine[FRAME_WIDTH];
+    Sprite sprites[64];
+    // sprites to rebuild on the next reload, a bit each, and what else
+    // has changed since the last one
+    uint64_t dirtySprites;
+    uint32_t chrGeneration;
+    int chrWriteLow;
+    int chrWriteHigh;
+};
+
+#endif